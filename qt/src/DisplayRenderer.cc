@@ -17,6 +17,7 @@
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QFileInfo>
 #include <QImageReader>
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #include <poppler-qt6.h>
@@ -74,26 +75,86 @@ void DisplayRenderer::adjustImage(QImage& image, int brightness, int contrast, b
 	}
 }
 
+QImage DisplayRenderer::renderRegion(int page, double resolution, const QRect& region) const {
+	return render(page, resolution).copy(region);
+}
+
 ImageRenderer::ImageRenderer(const QString& filename) : DisplayRenderer(filename) {
-	m_pageCount = QImageReader(m_filename).imageCount();
+	QImageReader* reader = new QImageReader(m_filename);
+	reader->setBackgroundColor(Qt::white);
+	m_pageCount = reader->imageCount();
+	releaseReader(reader);
+}
+
+ImageRenderer::~ImageRenderer() {
+	qDeleteAll(m_readers);
+}
+
+int ImageRenderer::countPages(const QString& filename) {
+	// Formats which cannot hold multiple images do not need to be opened
+	static const QStringList singleImageFormats = {"bmp", "jpeg", "jpg", "pbm", "pgm", "png", "pnm", "ppm", "xbm", "xpm"};
+	if (singleImageFormats.contains(QFileInfo(filename).suffix().toLower())) {
+		return 1;
+	}
+	return QImageReader(filename).imageCount();
 }
 
 QImage ImageRenderer::render(int page, double resolution) const {
-	QImageReader reader(m_filename);
-	reader.jumpToImage(page - 1);
-	reader.setBackgroundColor(Qt::white);
-	reader.setScaledSize(reader.size() * resolution / 100.0);
-	return reader.read().convertToFormat(QImage::Format_RGB32);
+	bool randomAccess = false;
+	QImageReader* reader = acquireReader(page, randomAccess);
+	reader->setScaledSize(reader->size() * resolution / 100.0);
+	QImage image = reader->read().convertToFormat(QImage::Format_RGB32);
+	releaseReader(reader, randomAccess);
+	return image;
 }
 
 QImage ImageRenderer::renderThumbnail(int page) const {
-	QImageReader reader(m_filename);
-	reader.jumpToImage(page - 1);
-	reader.setBackgroundColor(Qt::white);
-	QSize size = reader.size();
+	bool randomAccess = false;
+	QImageReader* reader = acquireReader(page, randomAccess);
+	QSize size = reader->size();
 	double scale = size.width() > size.height() ? (64. / size.width()) : (64. / size.height());
-	reader.setScaledSize(size * scale);
-	return reader.read().convertToFormat(QImage::Format_RGB32);
+	// Codecs supporting it (e.g. JPEG) directly decode at the reduced size
+	reader->setScaledSize(size * scale);
+	QImage image = reader->read().convertToFormat(QImage::Format_RGB32);
+	releaseReader(reader, randomAccess);
+	return image;
+}
+
+QImageReader* ImageRenderer::acquireReader(int page, bool& randomAccess) const {
+	QImageReader* reader = nullptr;
+	{
+		QMutexLocker locker(&m_readersMutex);
+		if (!m_readers.isEmpty()) {
+			reader = m_readers.takeLast();
+		}
+	}
+	// The open decoder keeps the directory of a multi-page image (e.g. the TIFF IFD offsets)
+	// around, so jumping to an arbitrary page does not rescan the file.
+	randomAccess = reader && reader->jumpToImage(page - 1);
+	if (reader && !randomAccess) {
+		// The pooled decoder is in an unknown state, e.g. after a read error
+		delete reader;
+		reader = nullptr;
+	}
+	if (!reader) {
+		reader = new QImageReader(m_filename);
+		reader->setBackgroundColor(Qt::white);
+		randomAccess = reader->jumpToImage(page - 1);
+	}
+	return reader;
+}
+
+void ImageRenderer::releaseReader(QImageReader* reader, bool randomAccess) const {
+	// Single-image decoders and decoders which can only read sequentially (e.g. GIF) cannot be
+	// rewound after reading, only keep the ones which can jump between the pages
+	if (m_pageCount > 1 && randomAccess) {
+		QMutexLocker locker(&m_readersMutex);
+		if (m_readers.size() < s_maxReaders) {
+			m_readers.append(reader);
+			return;
+		}
+	}
+	delete reader;
 }
 
 PDFRenderer::PDFRenderer(const QString& filename, const QByteArray& password) : DisplayRenderer(filename) {
@@ -112,6 +173,21 @@ PDFRenderer::PDFRenderer(const QString& filename, const QByteArray& password) :
 	}
 }
 
+int PDFRenderer::countPages(const QString& filename, const QByteArray& password) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+	std::unique_ptr<Poppler::Document> document = Poppler::Document::load(filename);
+#else
+	std::unique_ptr<Poppler::Document> document(Poppler::Document::load(filename));
+#endif
+	if (!document) {
+		return 1;
+	}
+	if (document->isLocked()) {
+		document->unlock(password, password);
+	}
+	return document->numPages();
+}
+
 QImage PDFRenderer::render(int page, double resolution) const {
 	if (!m_document) {
 		return QImage();
@@ -138,6 +214,17 @@ QImage PDFRenderer::renderThumbnail(int page) const {
 	return image.convertToFormat(QImage::Format_RGB32);
 }
 
+QImage PDFRenderer::renderRegion(int page, double resolution, const QRect& region) const {
+	if (!m_document) {
+		return QImage();
+	}
+	m_mutex.lock();
+	std::unique_ptr<Poppler::Page> poppage(m_document->page(page - 1));
+	m_mutex.unlock();
+	QImage image = poppage->renderToImage(resolution, resolution, region.x(), region.y(), region.width(), region.height());
+	return image.convertToFormat(QImage::Format_RGB32);
+}
+
 int PDFRenderer::getNPages() const {
 	return m_document ? m_document->numPages() : 1;
 }
@@ -151,16 +238,32 @@ DJVURenderer::~DJVURenderer() {
 	delete m_djvu;
 }
 
+int DJVURenderer::countPages(const QString& filename) {
+	// Only reads the document directory, not the individual pages
+	DjVuDocument djvu;
+	return djvu.openFile(filename) ? djvu.pageCount() : 0;
+}
+
 QImage DJVURenderer::render(int page, double resolution) const {
 	return m_djvu->image(page, resolution);
 }
 
 QImage DJVURenderer::renderThumbnail(int pageno) const {
-	const DjVuDocument::Page& page = m_djvu->page(pageno);
+	if (pageno < 0 || pageno >= m_djvu->pageCount()) {
+		return QImage();
+	}
+	const DjVuDocument::Page page = m_djvu->page(pageno);
+	if (page.dpi <= 0) {
+		return QImage();
+	}
 	double resolution = 64. / qMax(page.width, page.height) * page.dpi;
 	return m_djvu->image(pageno, resolution);
 }
 
+QImage DJVURenderer::renderRegion(int page, double resolution, const QRect& region) const {
+	return m_djvu->image(page, resolution, region);
+}
+
 int DJVURenderer::getNPages() const {
 	return m_djvu->pageCount();
 }
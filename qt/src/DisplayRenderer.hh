@@ -21,12 +21,15 @@
 #define DISPLAYRENDERER_HH
 
 #include <QByteArray>
+#include <QList>
 #include <QString>
 #include <QMutex>
+#include <QRect>
 
 class DjVuDocument;
 
 class QImage;
+class QImageReader;
 namespace Poppler {
 class Document;
 }
@@ -37,6 +40,12 @@ public:
 	virtual ~DisplayRenderer() {}
 	virtual QImage render(int page, double resolution) const = 0;
 	virtual QImage renderThumbnail(int page) const = 0;
+	// Renders only the given region (in pixels at the specified resolution) of the page
+	virtual QImage renderRegion(int page, double resolution, const QRect& region) const;
+	// Whether rendering at a higher resolution yields more detail than the source data
+	virtual bool isScalable() const {
+		return false;
+	}
 	virtual int getNPages() const = 0;
 
 	void adjustImage(QImage& image, int brightness, int contrast, bool invert) const;
@@ -48,20 +57,36 @@ protected:
 class ImageRenderer : public DisplayRenderer {
 public:
 	ImageRenderer(const QString& filename) ;
+	~ImageRenderer();
+	static int countPages(const QString& filename);
 	QImage render(int page, double resolution) const override;
 	QImage renderThumbnail(int page) const override;
 	int getNPages() const override {
 		return m_pageCount;
 	}
 private:
+	static constexpr int s_maxReaders = 4;
+
 	int m_pageCount;
+	// Open decoders of multi-page images, reused so that the image directory is only scanned once
+	mutable QList<QImageReader*> m_readers;
+	mutable QMutex m_readersMutex;
+
+	// randomAccess is set to whether the decoder could jump to the page, only such decoders are reused
+	QImageReader* acquireReader(int page, bool& randomAccess) const;
+	void releaseReader(QImageReader* reader, bool randomAccess) const;
 };
 
 class PDFRenderer : public DisplayRenderer {
 public:
 	PDFRenderer(const QString& filename, const QByteArray& password);
+	static int countPages(const QString& filename, const QByteArray& password);
 	QImage render(int page, double resolution) const override;
 	QImage renderThumbnail(int page) const override;
+	QImage renderRegion(int page, double resolution, const QRect& region) const override;
+	bool isScalable() const override {
+		return true;
+	}
 	int getNPages() const override;
 
 private:
@@ -73,8 +98,13 @@ class DJVURenderer : public DisplayRenderer {
 public:
 	DJVURenderer(const QString& filename);
 	~DJVURenderer();
+	static int countPages(const QString& filename);
 	QImage render(int page, double resolution) const override;
 	QImage renderThumbnail(int page) const override;
+	QImage renderRegion(int page, double resolution, const QRect& region) const override;
+	bool isScalable() const override {
+		return true;
+	}
 	int getNPages() const override;
 
 private:
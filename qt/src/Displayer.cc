@@ -22,19 +22,22 @@
 #include "Displayer.hh"
 #include "DisplayRenderer.hh"
 #include "SourceManager.hh"
+#include "ThumbnailModel.hh"
 #include "Utils.hh"
 
 #include <cmath>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QFuture>
 #include <QGraphicsPixmapItem>
 #include <QGraphicsSceneDragDropEvent>
+#include <QListView>
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QScrollBar>
 #include <QWheelEvent>
-#include <QtConcurrent/QtConcurrentRun>
 #include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
 
 
 class GraphicsScene : public QGraphicsScene {
@@ -86,17 +89,15 @@ Displayer::Displayer(const UI_MainWindow& _ui, QWidget* parent)
 	connect(&m_renderTimer, &QTimer::timeout, this, &Displayer::renderImage);
 	connect(&m_scaleTimer, &QTimer::timeout, this, &Displayer::scaleImage);
 	connect(&m_scaleWatcher, &QFutureWatcher<QImage>::finished, this, [this] { setScaledImage(m_scaleWatcher.future().result()); });
-	connect(&m_thumbnailWatcher, &QFutureWatcher<QImage>::resultReadyAt, this, &Displayer::setThumbnail);
-	connect(ui.listWidgetThumbnails, &QListWidget::currentRowChanged, [this](int idx) {
-		if (ui.checkBoxThumbnails->isChecked()) {
-			ui.spinBoxPage->setValue(idx + 1);
+	m_thumbnailModel = new ThumbnailModel(ui.listViewThumbnails, [this](int page) { return renderThumbnail(page); }, this);
+	ui.listViewThumbnails->setModel(m_thumbnailModel);
+	connect(ui.listViewThumbnails->selectionModel(), &QItemSelectionModel::currentRowChanged, [this](const QModelIndex & idx) {
+		if (ui.checkBoxThumbnails->isChecked() && idx.isValid()) {
+			ui.spinBoxPage->setValue(idx.row() + 1);
 		}
 	});
 	connect(ui.checkBoxThumbnails, &QCheckBox::toggled, this, &Displayer::thumbnailsToggled);
-	connect(ui.spinBoxPage, qOverload<int> (&QSpinBox::valueChanged), this, [this](int page) {
-		QSignalBlocker blocker(ui.listWidgetThumbnails);
-		ui.listWidgetThumbnails->setCurrentRow(page - 1);
-	});
+	connect(ui.spinBoxPage, qOverload<int> (&QSpinBox::valueChanged), this, &Displayer::setCurrentThumbnail);
 	connect(horizontalScrollBar(), &QScrollBar::valueChanged, this, &Displayer::checkViewportChanged);
 	connect(horizontalScrollBar(), &QScrollBar::rangeChanged, this, &Displayer::checkViewportChanged);
 	connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &Displayer::checkViewportChanged);
@@ -117,9 +118,7 @@ bool Displayer::setSources(QList<Source*> sources) {
 
 	m_scaleTimer.stop();
 	m_scaleWatcher.waitForFinished();
-	m_thumbnailWatcher.cancel();
-	m_thumbnailWatcher.waitForFinished();
-	ui.listWidgetThumbnails->clear();
+	m_thumbnailModel->setPageCount(0);
 	if (m_tool) {
 		m_tool->reset();
 	}
@@ -129,11 +128,17 @@ bool Displayer::setSources(QList<Source*> sources) {
 		delete m_imageItem;
 	}
 	m_currentSource = nullptr;
-	qDeleteAll(m_sourceRenderers);
+	cancelPageCounts();
+	m_rendererMutex.lock();
 	m_sourceRenderers.clear();
-	m_sources.clear();
+	m_rendererLru.clear();
 	m_pageMap.clear();
+	m_rendererMutex.unlock();
+	m_sources.clear();
+	m_sourcePageCounts.clear();
+	m_mappedSources = 0;
 	m_pixmap = QPixmap();
+	m_mipmaps.clear();
 	m_imageItem = nullptr;
 	ui.actionBestFit->setChecked(true);
 	ui.actionPage->setVisible(false);
@@ -162,37 +167,41 @@ bool Displayer::setSources(QList<Source*> sources) {
 		return false;
 	}
 
-	int page = 0;
-	for (Source* source : m_sources) {
-		DisplayRenderer* renderer = nullptr;
-		if (source->path.endsWith(".pdf", Qt::CaseInsensitive)) {
-			renderer = new PDFRenderer(source->path, source->password);
-			if (source->resolution == -1) { source->resolution = 300; }
-		} else if (source->path.endsWith(".djvu", Qt::CaseInsensitive)) {
-			renderer = new DJVURenderer(source->path);
-			if (source->resolution == -1) { source->resolution = 300; }
-		} else {
-			renderer = new ImageRenderer(source->path);
-			if (source->resolution == -1) { source->resolution = 100; }
+	// Pages are only counted right away until the first page to show is known, the
+	// remaining uncached sources (which may need to be fully loaded) are counted in the background
+	m_sourcePageCounts.fill(s_pageCountPending, m_sources.size());
+	QList<QPair<QString, QByteArray>> pending;
+	bool hasPages = false;
+	for (int i = 0, n = m_sources.size(); i < n; ++i) {
+		Source* source = m_sources[i];
+		if (source->resolution == -1) {
+			bool vector = source->path.endsWith(".pdf", Qt::CaseInsensitive) || source->path.endsWith(".djvu", Qt::CaseInsensitive);
+			source->resolution = vector ? 300 : 100;
 		}
-		if (renderer->getNPages() >= 0) {
-			source->angle.resize(renderer->getNPages());   // getNPages can potentially return -1
-		}
-		m_sourceRenderers[source] = renderer;
-		for (int iPage = 1, nPages = renderer->getNPages(); iPage <= nPages; ++iPage) {
-			m_pageMap.insert(++page, qMakePair(source, iPage));
+		int nPages = 0;
+		if (cachedPageCount(source, nPages)) {
+			m_sourcePageCounts[i] = nPages;
+		} else if (!hasPages) {
+			m_sourcePageCounts[i] = countPages(source);
+		} else {
+			m_pageCountSources.append(i);
+			pending.append(qMakePair(source->path, source->password));
 		}
+		hasPages |= m_sourcePageCounts[i] > 0;
 	}
-	if (page == 0) {
+	mapSourcePages();
+	if (m_pageMap.isEmpty()) {
 		return setSources(QList<Source*>());   // cleanup
 	}
+	if (!pending.isEmpty()) {
+		m_pageCountWatcher = new QFutureWatcher<int>(this);
+		QFutureWatcher<int>* watcher = m_pageCountWatcher;
+		connect(watcher, &QFutureWatcher<int>::resultsReadyAt, this, [this, watcher](int begin, int end) { pageCountReady(watcher, begin, end); });
+		watcher->setFuture(QtConcurrent::mapped(pending, &Displayer::countSourcePages));
+	}
 
 	generateThumbnails();
 
-	ui.spinBoxPage->blockSignals(true);
-	ui.spinBoxPage->setMaximum(page);
-	ui.spinBoxPage->blockSignals(false);
-	ui.actionPage->setVisible(page > 1);
 	m_imageItem = new QGraphicsPixmapItem();
 	m_imageItem->setTransformationMode(Qt::SmoothTransformation);
 	m_scene->addItem(m_imageItem);
@@ -210,8 +219,7 @@ bool Displayer::setup(const int* page, const int* resolution, const double* angl
 	if (page) {
 		changed |= *page != ui.spinBoxPage->value();
 		Utils::setSpinBlocked(ui.spinBoxPage, *page);
-		QSignalBlocker blocker(ui.listWidgetThumbnails);
-		ui.listWidgetThumbnails->setCurrentRow(*page - 1);
+		setCurrentThumbnail(*page);
 	}
 	if (resolution) {
 		changed |= *resolution != ui.spinBoxResolution->value();
@@ -276,7 +284,7 @@ bool Displayer::renderImage() {
 	Utils::setSpinBlocked(ui.spinBoxRotation, m_currentSource->angle[m_currentSource->page - 1]);
 
 	// Render new image
-	DisplayRenderer* renderer = m_sourceRenderers[m_currentSource];
+	std::shared_ptr<DisplayRenderer> renderer = getRenderer(m_currentSource);
 	if (!renderer) {
 		return false;
 	}
@@ -286,6 +294,7 @@ bool Displayer::renderImage() {
 	}
 	renderer->adjustImage(image, m_currentSource->brightness, m_currentSource->contrast, m_currentSource->invert);
 	m_pixmap = QPixmap::fromImage(image);
+	m_mipmaps = {image};
 	m_imageItem->setPixmap(m_pixmap);
 	m_imageItem->setScale(1.);
 	m_imageItem->setTransformOriginPoint(m_imageItem->boundingRect().center());
@@ -441,6 +450,7 @@ void Displayer::setAngle(double angle) {
 		if (m_rotateMode == RotateMode::CurrentPage) {
 			m_currentSource->angle[sourcePage - 1] = angle;
 		} else if (delta != 0) {
+			waitForPageCounts();
 			for (int page : m_pageMap.keys()) {
 				auto pair = m_pageMap[page];
 				double newangle = pair.first->angle[pair.second - 1] + delta;
@@ -564,6 +574,44 @@ QImage Displayer::getImage(const QRectF& rect) {
 	return image;
 }
 
+QImage Displayer::getImage(const QRectF& rect, int resolution) {
+	// Raster sources contain no additional detail, just crop the current image
+	std::shared_ptr<DisplayRenderer> renderer = getRenderer(m_currentSource);
+	if (!renderer || !renderer->isScalable() || resolution == m_currentSource->resolution) {
+		return getImage(rect);
+	}
+	double factor = double (resolution) / m_currentSource->resolution;
+	double angle = ui.spinBoxRotation->value();
+
+	// Map the (rotated) scene rect to the page, and render only the corresponding region at the requested resolution
+	QTransform pageToScene;
+	pageToScene.rotate(angle);
+	pageToScene.translate(-0.5 * m_pixmap.width(), -0.5 * m_pixmap.height());
+	QRectF pageRect = pageToScene.inverted().mapRect(rect);
+	QRect region = QRectF(pageRect.topLeft() * factor, pageRect.size() * factor).toAlignedRect();
+	region &= QRect(QPoint(0, 0), m_pixmap.size() * factor);
+	QImage regionImage = region.isEmpty() ? QImage() : renderer->renderRegion(m_currentSource->page, resolution, region);
+	if (regionImage.isNull()) {
+		return getImage(rect);
+	}
+	renderer->adjustImage(regionImage, m_currentSource->brightness, m_currentSource->contrast, m_currentSource->invert);
+
+	QImage image(rect.width() * factor, rect.height() * factor, QImage::Format_RGB32);
+	image.fill(Qt::black);
+	QPainter painter(&image);
+	painter.setRenderHint(QPainter::SmoothPixmapTransform);
+	QTransform t;
+	t.scale(factor, factor);
+	t.translate(-rect.x(), -rect.y());
+	t.rotate(angle);
+	t.translate(-0.5 * m_pixmap.width(), -0.5 * m_pixmap.height());
+	t.scale(1. / factor, 1. / factor);
+	t.translate(region.x(), region.y());
+	painter.setTransform(t);
+	painter.drawImage(0, 0, regionImage);
+	return image;
+}
+
 QRectF Displayer::getSceneBoundingRect() const {
 	// We cannot use m_imageItem->sceneBoundingRect() since its pixmap
 	// can currently be downscaled and therefore have slightly different
@@ -584,23 +632,61 @@ void Displayer::setBlockAutoscale(bool block) {
 }
 
 void Displayer::scaleImage() {
-	int page = m_currentSource->page;
-	double resolution = m_scale * m_currentSource->resolution;
-	int brightness = m_currentSource->brightness;
-	int contrast = m_currentSource->contrast;
-	bool invert = m_currentSource->invert;
-	QFuture<QImage> future = QtConcurrent::run([ = ] {
-		DisplayRenderer* renderer = m_sourceRenderers[m_currentSource];
-		if (!renderer) {
-			return QImage();
+	// Zooming out does not need a re-render, the full resolution image is downsampled instead
+	double scale = m_scale;
+	QFuture<QImage> future = QtConcurrent::run([this, scale] {
+		return downscaledImage(scale);
+	});
+	m_scaleWatcher.setFuture(future);
+}
+
+static QImage halveImage(const QImage& src) {
+	// 2x2 box filter, the last row/column is replicated for odd sizes
+	int width = std::max(1, src.width() / 2);
+	int height = std::max(1, src.height() / 2);
+	QImage dst(width, height, src.format());
+	for (int y = 0; y < height; ++y) {
+		const QRgb* row0 = reinterpret_cast<const QRgb*>(src.constScanLine(std::min(2 * y, src.height() - 1)));
+		const QRgb* row1 = reinterpret_cast<const QRgb*>(src.constScanLine(std::min(2 * y + 1, src.height() - 1)));
+		QRgb* out = reinterpret_cast<QRgb*>(dst.scanLine(y));
+		for (int x = 0; x < width; ++x) {
+			int x0 = std::min(2 * x, src.width() - 1);
+			int x1 = std::min(2 * x + 1, src.width() - 1);
+			QRgb a = row0[x0], b = row0[x1], c = row1[x0], d = row1[x1];
+			out[x] = qRgba((qRed(a) + qRed(b) + qRed(c) + qRed(d) + 2) / 4,
+			               (qGreen(a) + qGreen(b) + qGreen(c) + qGreen(d) + 2) / 4,
+			               (qBlue(a) + qBlue(b) + qBlue(c) + qBlue(d) + 2) / 4,
+			               (qAlpha(a) + qAlpha(b) + qAlpha(c) + qAlpha(d) + 2) / 4);
 		}
-		QImage image = renderer->render(page, resolution);
-		if (!image.isNull()) {
-			renderer->adjustImage(image, brightness, contrast, invert);
+	}
+	return dst;
+}
+
+QImage Displayer::downscaledImage(double scale) {
+	QMutexLocker locker(&m_mipmapMutex);
+	if (m_mipmaps.isEmpty()) {
+		return QImage();
+	}
+	if (m_mipmaps.first().format() != QImage::Format_RGB32 && m_mipmaps.first().format() != QImage::Format_ARGB32) {
+		m_mipmaps = {m_mipmaps.first().convertToFormat(QImage::Format_ARGB32)};
+	}
+	QSize size = m_mipmaps.first().size();
+	QSize target(std::max(1, qRound(size.width() * scale)), std::max(1, qRound(size.height() * scale)));
+	// Use the smallest level which is still at least as large as the target, building it if necessary
+	int level = 0;
+	while (m_mipmaps[level].width() / 2 >= target.width() && m_mipmaps[level].height() / 2 >= target.height()) {
+		if (level + 1 == m_mipmaps.size()) {
+			QImage next = halveImage(m_mipmaps[level]);
+			m_mipmaps.append(next);
 		}
+		++level;
+	}
+	QImage image = m_mipmaps[level];
+	locker.unlock();
+	if (image.size() == target) {
 		return image;
-	});
-	m_scaleWatcher.setFuture(future);
+	}
+	return image.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 }
 
 void Displayer::setScaledImage(QImage image) {
@@ -613,45 +699,170 @@ void Displayer::setScaledImage(QImage image) {
 }
 
 void Displayer::thumbnailsToggled(bool active) {
-	ui.listWidgetThumbnails->setVisible(active);
+	ui.listViewThumbnails->setVisible(active);
 	ui.splitter->setSizes(active ? QList<int>() << 50 << 50 : QList<int>() << ui.tabSources->height() << 1);
 	if (active) {
 		if (!m_pageMap.isEmpty()) {
 			generateThumbnails();
-			QSignalBlocker blocker(ui.listWidgetThumbnails);
-			ui.listWidgetThumbnails->setCurrentRow(ui.spinBoxPage->value() - 1);
+			setCurrentThumbnail(ui.spinBoxPage->value());
 		}
 	} else {
-		m_thumbnailWatcher.cancel();
-		m_thumbnailWatcher.waitForFinished();
-		ui.listWidgetThumbnails->clear();
+		m_thumbnailModel->setPageCount(0);
 	}
 }
 
 void Displayer::generateThumbnails() {
 	if (ui.checkBoxThumbnails->isChecked()) {
-		QList<int> pages = m_pageMap.keys();
-		ui.listWidgetThumbnails->setUpdatesEnabled(false);
-		QIcon icon(":/icons/thumbnail");
-		for (int page : pages) {
-			QListWidgetItem* item = new QListWidgetItem(icon, _("Page %1").arg(page));
-			ui.listWidgetThumbnails->addItem(item);
-		}
-		ui.listWidgetThumbnails->setUpdatesEnabled(true);
-		m_thumbnailWatcher.setFuture(QtConcurrent::mapped(pages, static_cast<std::function<QImage(int) >> ([this](int page) { return renderThumbnail(page); })));
+		// Thumbnails are rendered lazily by the model as rows become visible
+		m_thumbnailModel->setPageCount(m_pageMap.size());
+	}
+}
+
+void Displayer::setCurrentThumbnail(int page) {
+	m_thumbnailModel->setCurrentPage(page);
+	QModelIndex index = m_thumbnailModel->index(page - 1);
+	if (index.isValid()) {
+		QSignalBlocker blocker(ui.listViewThumbnails->selectionModel());
+		ui.listViewThumbnails->setCurrentIndex(index);
+		ui.listViewThumbnails->scrollTo(index);
+		ui.listViewThumbnails->viewport()->update();
 	}
 }
 
 QImage Displayer::renderThumbnail(int page) {
-	QPair<Source*, int> map = m_pageMap[page];
-	DisplayRenderer* renderer = m_sourceRenderers[map.first];
+	m_rendererMutex.lock();
+	QPair<Source*, int> map = m_pageMap.value(page);
+	m_rendererMutex.unlock();
+	std::shared_ptr<DisplayRenderer> renderer = getRenderer(map.first);
 	return renderer ? renderer->renderThumbnail(map.second) : QImage();
 }
 
-void Displayer::setThumbnail(int index) {
-	QImage image = m_thumbnailWatcher.resultAt(index);
-	if (!image.isNull()) {
-		ui.listWidgetThumbnails->item(index)->setIcon(QPixmap::fromImage(image));
+std::shared_ptr<DisplayRenderer> Displayer::getRenderer(Source* source) {
+	if (!source) {
+		return nullptr;
+	}
+	QMutexLocker locker(&m_rendererMutex);
+	std::shared_ptr<DisplayRenderer> renderer = m_sourceRenderers.value(source);
+	if (!renderer) {
+		// Opening the document may take a while, don't block other threads meanwhile
+		locker.unlock();
+		std::shared_ptr<DisplayRenderer> newRenderer;
+		if (source->path.endsWith(".pdf", Qt::CaseInsensitive)) {
+			newRenderer = std::make_shared<PDFRenderer>(source->path, source->password);
+		} else if (source->path.endsWith(".djvu", Qt::CaseInsensitive)) {
+			newRenderer = std::make_shared<DJVURenderer>(source->path);
+		} else {
+			newRenderer = std::make_shared<ImageRenderer>(source->path);
+		}
+		locker.relock();
+		// Another thread may have opened the same document meanwhile
+		renderer = m_sourceRenderers.value(source);
+		if (!renderer) {
+			renderer = newRenderer;
+			m_sourceRenderers.insert(source, renderer);
+		}
+	}
+	m_rendererLru.removeOne(source);
+	m_rendererLru.append(source);
+	// Close the least recently used documents. Renderers still in use (i.e. by a thumbnail job) are released once done.
+	while (m_rendererLru.size() > s_maxOpenRenderers) {
+		m_sourceRenderers.remove(m_rendererLru.takeFirst());
+	}
+	return renderer;
+}
+
+bool Displayer::cachedPageCount(const Source* source, int& nPages) const {
+	// Page counts are remembered as long as the file is not modified, so that reselecting sources is immediate
+	auto it = m_pageCountCache.find(source->path);
+	if (it != m_pageCountCache.end() && it.value().first == QFileInfo(source->path).lastModified()) {
+		nPages = it.value().second;
+		return true;
+	}
+	return false;
+}
+
+int Displayer::countPages(const Source* source) {
+	QDateTime modified = QFileInfo(source->path).lastModified();
+	int nPages = countSourcePages(qMakePair(source->path, source->password));
+	m_pageCountCache.insert(source->path, qMakePair(modified, nPages));
+	return nPages;
+}
+
+int Displayer::countSourcePages(const QPair<QString, QByteArray>& source) {
+	if (source.first.endsWith(".pdf", Qt::CaseInsensitive)) {
+		return PDFRenderer::countPages(source.first, source.second);
+	} else if (source.first.endsWith(".djvu", Qt::CaseInsensitive)) {
+		return DJVURenderer::countPages(source.first);
+	} else {
+		return ImageRenderer::countPages(source.first);
+	}
+}
+
+void Displayer::cancelPageCounts() {
+	if (m_pageCountWatcher) {
+		// The jobs only access their own copy of the source paths, so there is no need to wait for them
+		m_pageCountWatcher->disconnect(this);
+		m_pageCountWatcher->cancel();
+		connect(m_pageCountWatcher, &QFutureWatcher<int>::finished, m_pageCountWatcher, &QObject::deleteLater);
+		if (m_pageCountWatcher->isFinished()) {
+			m_pageCountWatcher->deleteLater();
+		}
+		m_pageCountWatcher = nullptr;
+	}
+	m_pageCountSources.clear();
+}
+
+void Displayer::waitForPageCounts() {
+	if (m_pageCountWatcher) {
+		m_pageCountWatcher->waitForFinished();
+		pageCountReady(m_pageCountWatcher, 0, m_pageCountSources.size());
+	}
+}
+
+void Displayer::pageCountReady(QFutureWatcher<int>* watcher, int begin, int end) {
+	if (watcher != m_pageCountWatcher) {
+		return;
+	}
+	for (int i = begin; i < end; ++i) {
+		int sourceIdx = m_pageCountSources[i];
+		// Results may already have been collected by waitForPageCounts
+		if (m_sourcePageCounts[sourceIdx] == s_pageCountPending) {
+			const Source* source = m_sources[sourceIdx];
+			m_sourcePageCounts[sourceIdx] = watcher->resultAt(i);
+			m_pageCountCache.insert(source->path, qMakePair(QFileInfo(source->path).lastModified(), m_sourcePageCounts[sourceIdx]));
+		}
+	}
+	mapSourcePages();
+	if (m_mappedSources == m_sources.size()) {
+		cancelPageCounts();
+	}
+}
+
+void Displayer::mapSourcePages() {
+	// Pages are numbered in source order, so only the sources up to the first one still being counted can be added
+	int oldPages = m_pageMap.size();
+	int page = oldPages;
+	QMutexLocker locker(&m_rendererMutex);
+	for (int n = m_sources.size(); m_mappedSources < n && m_sourcePageCounts[m_mappedSources] != s_pageCountPending; ++m_mappedSources) {
+		Source* source = m_sources[m_mappedSources];
+		int nPages = m_sourcePageCounts[m_mappedSources];
+		if (nPages >= 0) {
+			source->angle.resize(nPages);   // nPages can potentially be -1
+		}
+		for (int iPage = 1; iPage <= nPages; ++iPage) {
+			m_pageMap.insert(++page, qMakePair(source, iPage));
+		}
+	}
+	locker.unlock();
+	if (page == oldPages) {
+		return;
+	}
+	ui.spinBoxPage->blockSignals(true);
+	ui.spinBoxPage->setMaximum(page);
+	ui.spinBoxPage->blockSignals(false);
+	ui.actionPage->setVisible(page > 1);
+	if (oldPages > 0 && m_thumbnailModel->rowCount() > 0) {
+		m_thumbnailModel->appendPages(page - oldPages);
 	}
 }
 
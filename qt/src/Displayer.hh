@@ -20,16 +20,23 @@
 #ifndef DISPLAYER_HH
 #define DISPLAYER_HH
 
+#include <QDateTime>
 #include <QFutureWatcher>
 #include <QGraphicsRectItem>
 #include <QGraphicsView>
+#include <QHash>
 #include <QImage>
 #include <QMap>
+#include <QMutex>
 #include <QTimer>
+#include <QVector>
+#include <limits>
+#include <memory>
 
 class DisplayerTool;
 class DisplayRenderer;
 class Source;
+class ThumbnailModel;
 class UI_MainWindow;
 class GraphicsScene;
 
@@ -45,7 +52,9 @@ public:
 	bool setup(const int* page = nullptr, const int* resolution = nullptr, const double* angle = nullptr);
 	int getCurrentPage() const;
 	int getNPages() const;
-	int getNSources() const { return m_sourceRenderers.size(); }
+	// Blocks until the pages of all sources are counted
+	void waitForPageCounts();
+	int getNSources() const { return m_sources.size(); }
 	int getCurrentResolution() const;
 	double getCurrentAngle() const;
 	double getCurrentScale() const {
@@ -54,6 +63,7 @@ public:
 	QString getCurrentImage(int& page) const;
 	bool resolvePage(int page, QString& source, int& sourcePage) const;
 	QImage getImage(const QRectF& rect);
+	QImage getImage(const QRectF& rect, int resolution);
 	QRectF getSceneBoundingRect() const;
 	QPointF mapToSceneClamped(const QPoint& p) const;
 	bool hasMultipleOCRAreas();
@@ -81,8 +91,20 @@ private:
 	const UI_MainWindow& ui;
 	GraphicsScene* m_scene;
 	QList<Source*> m_sources;
-	QMap<Source*, DisplayRenderer*> m_sourceRenderers;
+	// Renderers are created on first access, only the most recently used ones are kept open
+	static constexpr int s_maxOpenRenderers = 8;
+	QMap<Source*, std::shared_ptr<DisplayRenderer>> m_sourceRenderers;
+	QList<Source*> m_rendererLru;
+	QMutex m_rendererMutex;
+	QHash<QString, QPair<QDateTime, int>> m_pageCountCache;
+	// Guarded by m_rendererMutex while page counts are still being added, since thumbnail jobs read it
 	QMap<int, QPair<Source*, int >> m_pageMap;
+	// Page counts of m_sources, those not yet known are counted in the background
+	static constexpr int s_pageCountPending = std::numeric_limits<int>::min();
+	QVector<int> m_sourcePageCounts;
+	int m_mappedSources = 0;
+	QVector<int> m_pageCountSources;
+	QFutureWatcher<int>* m_pageCountWatcher = nullptr;
 	Source* m_currentSource = nullptr;
 	QPixmap m_pixmap;
 	QGraphicsPixmapItem* m_imageItem = nullptr;
@@ -91,6 +113,7 @@ private:
 	QPoint m_panPos;
 	QTimer m_renderTimer;
 	QTransform m_viewportTransform;
+	ThumbnailModel* m_thumbnailModel = nullptr;
 
 	void keyPressEvent(QKeyEvent* event) override;
 	void mousePressEvent(QMouseEvent* event) override;
@@ -99,14 +122,25 @@ private:
 	void resizeEvent(QResizeEvent* event) override;
 	void wheelEvent(QWheelEvent* event) override;
 
+	std::shared_ptr<DisplayRenderer> getRenderer(Source* source);
+	bool cachedPageCount(const Source* source, int& nPages) const;
+	int countPages(const Source* source);
+	static int countSourcePages(const QPair<QString, QByteArray>& source);
+	void cancelPageCounts();
+	void pageCountReady(QFutureWatcher<int>* watcher, int begin, int end);
+	void mapSourcePages();
 	void setZoom(Zoom action, QGraphicsView::ViewportAnchor anchor = QGraphicsView::AnchorViewCenter);
 	void generateThumbnails();
 	void thumbnailsToggled(bool active);
+	void setCurrentThumbnail(int page);
 
 	QTimer m_scaleTimer;
 	QFutureWatcher<QImage> m_scaleWatcher;
+	// Successively halved copies of the current full resolution image, built on demand when zooming out
+	QVector<QImage> m_mipmaps;
+	QMutex m_mipmapMutex;
 
-	QFutureWatcher<QImage> m_thumbnailWatcher;
+	QImage downscaledImage(double scale);
 
 private slots:
 	void adjustBrightness();
@@ -134,7 +168,6 @@ private slots:
 		setZoom(Zoom::Original);
 	}
 	QImage renderThumbnail(int page);
-	void setThumbnail(int index);
 };
 
 
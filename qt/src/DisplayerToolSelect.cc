@@ -248,7 +248,10 @@ void NumberedDisplayerSelection::contextMenuEvent(QGraphicsSceneContextMenuEvent
 	} else if (selected == ocrAction) {
 		MAIN->getRecognizer()->recognizeImage(m_tool->getDisplayer()->getImage(rect()), Recognizer::OutputDestination::Buffer);
 	} else if (selected == ocrClipboardAction) {
-		MAIN->getRecognizer()->recognizeImage(m_tool->getDisplayer()->getImage(rect()), Recognizer::OutputDestination::Clipboard);
+		// The clipboard output does not refer to page coordinates, so the selection can be rendered at a higher resolution
+		Displayer* displayer = m_tool->getDisplayer();
+		int resolution = std::max(displayer->getCurrentResolution(), 400);
+		MAIN->getRecognizer()->recognizeImage(displayer->getImage(rect(), resolution), Recognizer::OutputDestination::Clipboard);
 	} else if (selected == saveAction) {
 		static_cast<DisplayerToolSelect*> (m_tool)->saveSelection(this);
 	}
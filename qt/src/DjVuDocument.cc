@@ -14,35 +14,11 @@
 
 #include <QFile>
 #include <QPainter>
+#include <QThread>
 
 #include <libdjvu/ddjvuapi.h>
 #include <libdjvu/miniexp.h>
 
-/**
- * Explore the message queue until there are no message left in it.
- */
-static void handle_ddjvu_messages(ddjvu_context_t* ctx, int wait) {
-	const ddjvu_message_t* msg;
-	if (wait) {
-		ddjvu_message_wait(ctx);
-	}
-	while ((msg = ddjvu_message_peek(ctx))) {
-		ddjvu_message_pop(ctx);
-	}
-}
-
-/**
- * Explore the message queue until the message \p mid is found.
- */
-static void wait_for_ddjvu_message(ddjvu_context_t* ctx, ddjvu_message_tag_t mid) {
-	ddjvu_message_wait(ctx);
-	const ddjvu_message_t* msg;
-	while ((msg = ddjvu_message_peek(ctx)) && msg && (msg->m_any.tag != mid)) {
-		ddjvu_message_pop(ctx);
-	}
-}
-
-
 DjVuDocument::DjVuDocument() {
 	// creating the djvu context
 	m_djvu_cxt = ddjvu_context_create("DjVuDocument");
@@ -51,14 +27,52 @@ DjVuDocument::DjVuDocument() {
 	m_format = ddjvu_format_create(DDJVU_FORMAT_RGBMASK32, 4, formatmask);
 	ddjvu_format_set_row_order(m_format, 1);
 	ddjvu_format_set_y_direction(m_format, 1);
+	// start the message thread
+	ddjvu_message_set_callback(m_djvu_cxt, messageCallback, this);
+	m_messageThread = QThread::create([this] { processMessages(); });
+	m_messageThread->start();
 }
 
 DjVuDocument::~DjVuDocument() {
 	closeFile();
+	m_quit = true;
+	m_messageSemaphore.release();
+	m_messageThread->wait();
+	delete m_messageThread;
+	ddjvu_message_set_callback(m_djvu_cxt, nullptr, nullptr);
 	ddjvu_format_release(m_format);
 	ddjvu_context_release(m_djvu_cxt);
 }
 
+void DjVuDocument::messageCallback(ddjvu_context_t* /*ctx*/, void* data) {
+	// Invoked by whichever thread posts the message, must not call into ddjvuapi
+	static_cast<DjVuDocument*>(data)->m_messageSemaphore.release();
+}
+
+void DjVuDocument::processMessages() {
+	while (true) {
+		m_messageSemaphore.acquire();
+		if (m_quit) {
+			break;
+		}
+		while (ddjvu_message_peek(m_djvu_cxt)) {
+			ddjvu_message_pop(m_djvu_cxt);
+		}
+		QMutexLocker locker(&m_jobMutex);
+		m_jobCond.wakeAll();
+	}
+}
+
+int DjVuDocument::waitForJob(const std::function<int()>& status) {
+	QMutexLocker locker(&m_jobMutex);
+	int sts;
+	while ((sts = status()) < DDJVU_JOB_OK) {
+		// The timeout is just a safeguard in case the status changes without any message being posted
+		m_jobCond.wait(&m_jobMutex, 250);
+	}
+	return sts;
+}
+
 bool DjVuDocument::openFile(const QString& fileName) {
 	// first, close the old file
 	if (m_djvu_document) {
@@ -69,32 +83,30 @@ bool DjVuDocument::openFile(const QString& fileName) {
 	m_djvu_document = ddjvu_document_create_by_filename(m_djvu_cxt, QFile::encodeName(fileName).constData(), true);
 	if (!m_djvu_document) { return false; }
 	// ...and wait for its loading
-	wait_for_ddjvu_message(m_djvu_cxt, DDJVU_DOCINFO);
-	if (ddjvu_document_decoding_error(m_djvu_document)) {
+	if (waitForJob([this] { return ddjvu_document_decoding_status(m_djvu_document); }) >= DDJVU_JOB_FAILED) {
 		ddjvu_document_release(m_djvu_document);
 		m_djvu_document = nullptr;
 		return false;
 	}
 
-	int numofpages = ddjvu_document_get_pagenum(m_djvu_document);
 	m_pages.clear();
-	m_pages.resize(numofpages);
+	m_pages.resize(ddjvu_document_get_pagenum(m_djvu_document));
 
-	// read the pages
-	for (int i = 0; i < numofpages; ++i) {
-		ddjvu_status_t sts;
+	return true;
+}
+
+DjVuDocument::Page DjVuDocument::page(int pageno) {
+	QMutexLocker locker(&m_pagesMutex);
+	Page& page = m_pages[pageno];
+	if (page.dpi == 0) {
 		ddjvu_pageinfo_t info;
-		while ((sts = ddjvu_document_get_pageinfo(m_djvu_document, i, &info)) < DDJVU_JOB_OK) {
-			handle_ddjvu_messages(m_djvu_cxt, true);
-		}
-		if (sts >= DDJVU_JOB_FAILED) {
-			closeFile();
-			return false;
+		if (waitForJob([&] { return ddjvu_document_get_pageinfo(m_djvu_document, pageno, &info); }) < DDJVU_JOB_FAILED) {
+			page = {info.width, info.height, info.dpi};
+		} else {
+			page.dpi = -1;
 		}
-		m_pages[i] = {info.width, info.height, info.dpi};
 	}
-
-	return true;
+	return page;
 }
 
 void DjVuDocument::closeFile() {
@@ -106,19 +118,19 @@ void DjVuDocument::closeFile() {
 	m_djvu_document = nullptr;
 }
 
-QImage DjVuDocument::image(int pageno, int resolution) {
+QImage DjVuDocument::image(int pageno, int resolution, const QRect& region) {
 	if (pageno < 0 || pageno >= pageCount()) {
 		return QImage();
 	}
 
-	const DjVuDocument::Page& page = m_pages[pageno];
+	const DjVuDocument::Page page = this->page(pageno);
+	if (page.dpi <= 0) {
+		return QImage();
+	}
 
+	// decoding starts in the background as soon as the page is created, only this thread blocks until it is done
 	ddjvu_page_t* djvupage = ddjvu_page_create_by_pageno(m_djvu_document, pageno);
-	// wait for the new page to be loaded
-	ddjvu_status_t sts;
-	while ((sts = ddjvu_page_decoding_status(djvupage)) < DDJVU_JOB_OK) {
-		handle_ddjvu_messages(m_djvu_cxt, true);
-	}
+	waitForJob([djvupage] { return ddjvu_page_decoding_status(djvupage); });
 
 	double scaleFactor = double (resolution) / double (page.dpi);
 	ddjvu_rect_t pagerect;
@@ -127,6 +139,18 @@ QImage DjVuDocument::image(int pageno, int resolution) {
 	pagerect.w = page.width * scaleFactor;
 	pagerect.h = page.height * scaleFactor;
 	ddjvu_rect_t renderrect = pagerect;
+	if (!region.isNull()) {
+		// only the requested part of the page is rasterized
+		QRect rect = region.intersected(QRect(0, 0, pagerect.w, pagerect.h));
+		if (rect.isEmpty()) {
+			ddjvu_page_release(djvupage);
+			return QImage();
+		}
+		renderrect.x = rect.x();
+		renderrect.y = rect.y();
+		renderrect.w = rect.width();
+		renderrect.h = rect.height();
+	}
 	QImage res_img(renderrect.w, renderrect.h, QImage::Format_RGB32);
 	int res = ddjvu_page_render(djvupage, DDJVU_RENDER_COLOR, &pagerect, &renderrect, m_format, res_img.bytesPerLine(), (char*) res_img.bits());
 	if (!res) {
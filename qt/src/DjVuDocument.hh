@@ -14,7 +14,13 @@
 #define DJVUDOCUMENT_HH
 
 #include <QImage>
+#include <QMutex>
+#include <QSemaphore>
 #include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+class QThread;
 
 typedef struct ddjvu_context_s    ddjvu_context_t;
 typedef struct ddjvu_document_s   ddjvu_document_t;
@@ -26,25 +32,39 @@ public:
 	~DjVuDocument();
 
 	struct Page {
-		int width;
-		int height;
-		int dpi;
+		int width = 0;
+		int height = 0;
+		int dpi = 0; // 0: not yet read, -1: failed to read
 	};
 
 	bool openFile(const QString& fileName);
 	void closeFile();
-	QImage image(int pageno, int resolution);
+	QImage image(int pageno, int resolution, const QRect& region = QRect());
 	int pageCount() const {
 		return m_pages.size();
 	}
-	const Page& page(int pageno) const { return m_pages[pageno]; }
+	Page page(int pageno);
 
 private:
 
 	ddjvu_context_t* m_djvu_cxt = nullptr;
 	ddjvu_document_t* m_djvu_document = nullptr;
 	ddjvu_format_t* m_format = nullptr;
+	// Page infos are read on demand, so that opening a document only needs its directory
 	QVector<Page> m_pages;
+	QMutex m_pagesMutex;
+
+	// The message queue is drained by a dedicated thread, which wakes up the threads waiting for their jobs.
+	// This allows multiple pages to be decoded concurrently from different threads.
+	QThread* m_messageThread = nullptr;
+	QSemaphore m_messageSemaphore;
+	QMutex m_jobMutex;
+	QWaitCondition m_jobCond;
+	bool m_quit = false;
+
+	static void messageCallback(ddjvu_context_t* ctx, void* data);
+	void processMessages();
+	int waitForJob(const std::function<int()>& status);
 };
 
 #endif
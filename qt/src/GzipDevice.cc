@@ -0,0 +1,157 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * GzipDevice.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+#include <cstring>
+
+#include "GzipDevice.hh"
+
+// Adding 16 to the window bits selects the gzip format, adding 32 detects gzip and zlib streams when reading
+static constexpr int s_gzipWindowBits = 15 + 16;
+static constexpr int s_detectWindowBits = 15 + 32;
+
+
+GzipDevice::GzipDevice(QIODevice* device, QObject* parent)
+	: QIODevice(parent), m_device(device) {
+	m_stream = z_stream();
+}
+
+GzipDevice::~GzipDevice() {
+	if (isOpen()) {
+		close();
+	}
+}
+
+bool GzipDevice::open(OpenMode mode) {
+	if (isOpen() || (mode != ReadOnly && mode != WriteOnly) || !(m_device->openMode() & mode)) {
+		setErrorString("Invalid open mode");
+		return false;
+	}
+	m_stream = z_stream();
+	m_streamEnd = false;
+	m_error = false;
+	m_buffer.resize(s_bufferSize);
+	int ret = mode == ReadOnly ? inflateInit2(&m_stream, s_detectWindowBits) : deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, s_gzipWindowBits, 8, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK) {
+		setZlibError("Failed to initialize compression");
+		return false;
+	}
+	return QIODevice::open(mode);
+}
+
+void GzipDevice::close() {
+	if (!isOpen()) {
+		return;
+	}
+	if (openMode() & WriteOnly) {
+		m_stream.next_in = nullptr;
+		m_stream.avail_in = 0;
+		while (!m_error && deflateBuffer(Z_FINISH) != Z_STREAM_END) {}
+		deflateEnd(&m_stream);
+	} else {
+		inflateEnd(&m_stream);
+	}
+	m_buffer = QByteArray();
+	QIODevice::close();
+}
+
+bool GzipDevice::atEnd() const {
+	return (m_streamEnd || m_error) && QIODevice::atEnd();
+}
+
+qint64 GzipDevice::readData(char* data, qint64 maxlen) {
+	if (m_error) {
+		return -1;
+	}
+	uInt outSize = uInt(qMin<qint64>(maxlen, INT_MAX));
+	m_stream.next_out = reinterpret_cast<Bytef*> (data);
+	m_stream.avail_out = outSize;
+	while (m_stream.avail_out > 0 && !m_streamEnd && !m_error) {
+		if (m_stream.avail_in == 0) {
+			qint64 count = m_device->read(m_buffer.data(), m_buffer.size());
+			if (count <= 0) {
+				setZlibError(count < 0 ? m_device->errorString() : QString("Unexpected end of compressed data"));
+				break;
+			}
+			m_stream.next_in = reinterpret_cast<Bytef*> (m_buffer.data());
+			m_stream.avail_in = uInt(count);
+		}
+		int ret = inflate(&m_stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// Concatenated gzip members are read as one stream, any other trailing data (i.e. padding) is ignored
+			if (nextMemberFollows()) {
+				inflateReset(&m_stream);
+			} else {
+				m_streamEnd = true;
+			}
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			setZlibError("Corrupt compressed data");
+		}
+	}
+	qint64 count = outSize - m_stream.avail_out;
+	return count > 0 || !m_error ? count : -1;
+}
+
+qint64 GzipDevice::writeData(const char* data, qint64 len) {
+	qint64 written = 0;
+	while (written < len && !m_error) {
+		uInt chunk = uInt(qMin<qint64>(len - written, INT_MAX));
+		m_stream.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (data + written));
+		m_stream.avail_in = chunk;
+		while (m_stream.avail_in > 0 && !m_error) {
+			deflateBuffer(Z_NO_FLUSH);
+		}
+		written += chunk;
+	}
+	return m_error ? -1 : len;
+}
+
+bool GzipDevice::nextMemberFollows() {
+	// Move the pending input to the start of the buffer, so that the header magic can be read into it
+	if (m_stream.avail_in < 2) {
+		std::memmove(m_buffer.data(), m_stream.next_in, m_stream.avail_in);
+		m_stream.next_in = reinterpret_cast<Bytef*> (m_buffer.data());
+		qint64 count = 1;
+		while (m_stream.avail_in < 2 && count > 0) {
+			count = m_device->read(m_buffer.data() + m_stream.avail_in, m_buffer.size() - m_stream.avail_in);
+			m_stream.avail_in += uInt(qMax<qint64>(count, 0));
+		}
+	}
+	return m_stream.avail_in >= 2 && m_stream.next_in[0] == 0x1f && m_stream.next_in[1] == 0x8b;
+}
+
+int GzipDevice::deflateBuffer(int flush) {
+	m_stream.next_out = reinterpret_cast<Bytef*> (m_buffer.data());
+	m_stream.avail_out = uInt(m_buffer.size());
+	int ret = deflate(&m_stream, flush);
+	if (ret == Z_STREAM_ERROR) {
+		setZlibError("Compression failed");
+		return ret;
+	}
+	qint64 count = m_buffer.size() - m_stream.avail_out;
+	if (count > 0 && m_device->write(m_buffer.constData(), count) != count) {
+		setZlibError(m_device->errorString());
+	}
+	return ret;
+}
+
+void GzipDevice::setZlibError(const QString& message) {
+	m_error = true;
+	setErrorString(m_stream.msg ? QString("%1: %2").arg(message).arg(m_stream.msg) : message);
+}
@@ -0,0 +1,69 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * GzipDevice.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZIPDEVICE_HH
+#define GZIPDEVICE_HH
+
+#include <QIODevice>
+#include <zlib.h>
+
+/**
+ * Sequential device which transparently decompresses resp. compresses the
+ * gzip stream of an underlying open device, one buffer at a time.
+ */
+class GzipDevice : public QIODevice {
+public:
+	GzipDevice(QIODevice* device, QObject* parent = nullptr);
+	~GzipDevice();
+
+	static bool isGzipFile(const QString& filename) {
+		return filename.endsWith(".gz", Qt::CaseInsensitive);
+	}
+
+	// Either ReadOnly or WriteOnly
+	bool open(OpenMode mode) override;
+	// Also finishes the compressed stream when writing
+	void close() override;
+	bool isSequential() const override {
+		return true;
+	}
+	bool atEnd() const override;
+	bool hasError() const {
+		return m_error;
+	}
+
+protected:
+	qint64 readData(char* data, qint64 maxlen) override;
+	qint64 writeData(const char* data, qint64 len) override;
+
+private:
+	static constexpr int s_bufferSize = 64 * 1024;
+
+	QIODevice* m_device;
+	z_stream m_stream;
+	QByteArray m_buffer;
+	bool m_streamEnd = false;
+	bool m_error = false;
+
+	bool nextMemberFollows();
+	int deflateBuffer(int flush);
+	void setZlibError(const QString& message);
+};
+
+#endif // GZIPDEVICE_HH
@@ -240,7 +240,7 @@ MainWindow::MainWindow(const QStringList& files)
 	QStringList hocrFiles;
 	QStringList otherFiles;
 	for (const QString& file : files) {
-		if (file.endsWith(".html", Qt::CaseInsensitive)) {
+		if (file.endsWith(".html", Qt::CaseInsensitive) || file.endsWith(".html.gz", Qt::CaseInsensitive) || file.endsWith(".hocr.gz", Qt::CaseInsensitive) || file.endsWith(".ghocr", Qt::CaseInsensitive)) {
 			hocrFiles.append(file);
 		} else {
 			otherFiles.append(file);
@@ -277,7 +277,7 @@ void MainWindow::openOutput(const QString& filename) {
 		if (setOutputMode(OutputModeText)) {
 			m_outputEditor->open(filename);
 		}
-	} else if (filename.endsWith(".html", Qt::CaseInsensitive)) {
+	} else if (filename.endsWith(".html", Qt::CaseInsensitive) || filename.endsWith(".html.gz", Qt::CaseInsensitive) || filename.endsWith(".hocr.gz", Qt::CaseInsensitive) || filename.endsWith(".ghocr", Qt::CaseInsensitive)) {
 		if (setOutputMode(OutputModeHOCR)) {
 			m_outputEditor->open(filename);
 		}
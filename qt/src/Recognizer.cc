@@ -35,6 +35,7 @@
 
 #include "ConfigSettings.hh"
 #include "Displayer.hh"
+#include "GzipDevice.hh"
 #include "MainWindow.hh"
 #include "OutputEditor.hh"
 #include "RecognitionMenu.hh"
@@ -126,6 +127,7 @@ void Recognizer::clearLineEditPageRangeStyle() {
 }
 
 QList<int> Recognizer::selectPages(bool& autodetectLayout) {
+	MAIN->getDisplayer()->waitForPageCounts();
 	int nPages = MAIN->getDisplayer()->getNPages();
 
 	m_pagesDialogUi.lineEditPageRange->setText(QString("1-%1").arg(nPages));
@@ -175,6 +177,7 @@ QList<int> Recognizer::selectPages(bool& autodetectLayout) {
 }
 
 void Recognizer::recognizeButtonClicked() {
+	MAIN->getDisplayer()->waitForPageCounts();
 	int nPages = MAIN->getDisplayer()->getNPages();
 	if (nPages == 1) {
 		recognize({MAIN->getDisplayer()->getCurrentPage() });
@@ -333,12 +336,14 @@ void Recognizer::recognizeImage(const QImage& image, OutputDestination dest) {
 void Recognizer::recognizeBatch() {
 	m_batchDialogUi.checkBoxPrependPage->setVisible(MAIN->getDisplayer()->allowAutodetectOCRAreas());
 	m_batchDialogUi.checkBoxAutolayout->setVisible(MAIN->getDisplayer()->allowAutodetectOCRAreas());
+	m_batchDialogUi.checkBoxCompress->setVisible(MAIN->getOutputEditor()->inherits("OutputEditorHOCR"));
 	if (m_batchDialog->exec() != QDialog::Accepted) {
 		return;
 	}
 	BatchExistingBehaviour existingBehaviour = static_cast<BatchExistingBehaviour> (m_batchDialogUi.comboBoxExisting->currentData().toInt());
 	bool prependPage = MAIN->getDisplayer()->allowAutodetectOCRAreas() && m_batchDialogUi.checkBoxPrependPage->isChecked();
 	bool autolayout = MAIN->getDisplayer()->allowAutodetectOCRAreas() && m_batchDialogUi.checkBoxAutolayout->isChecked();
+	MAIN->getDisplayer()->waitForPageCounts();
 	int nPages = MAIN->getDisplayer()->getNPages();
 
 	auto tess = setupTesseract();
@@ -348,6 +353,7 @@ void Recognizer::recognizeBatch() {
 
 	QMap<QString, QVariant> batchOptions;
 	batchOptions["prependPage"] = prependPage;
+	batchOptions["compress"] = m_batchDialogUi.checkBoxCompress->isChecked();
 	OutputEditor::BatchProcessor* batchProcessor = MAIN->getOutputEditor()->createBatchProcessor(batchOptions);
 
 	QStringList errors;
@@ -358,6 +364,9 @@ void Recognizer::recognizeBatch() {
 		int idx = 0;
 		QString currFilename;
 		QFile outputFile;
+		// Output with a .gz suffix is compressed while it is written
+		GzipDevice gzipDevice(&outputFile);
+		QIODevice* output = &outputFile;
 		for (int page = 1; page <= nPages; ++page) {
 			monitor.desc.progress = 0;
 			++idx;
@@ -372,7 +381,8 @@ void Recognizer::recognizeBatch() {
 			}
 			if (pageData.pageInfo.filename != currFilename) {
 				if (outputFile.isOpen()) {
-					batchProcessor->writeFooter(&outputFile);
+					batchProcessor->writeFooter(output);
+					gzipDevice.close();
 					outputFile.close();
 				}
 				currFilename = pageData.pageInfo.filename;
@@ -386,7 +396,16 @@ void Recognizer::recognizeBatch() {
 					if (!outputFile.open(QIODevice::WriteOnly)) {
 						errors.append(_("- %1: failed to create output file").arg(finfo.fileName()).arg(page));
 					} else {
-						batchProcessor->writeHeader(&outputFile, tess->get(), pageData.pageInfo);
+						output = &outputFile;
+						if (GzipDevice::isGzipFile(fileName)) {
+							output = &gzipDevice;
+						}
+						if (output == &gzipDevice && !gzipDevice.open(QIODevice::WriteOnly)) {
+							errors.append(_("- %1: failed to compress output file: %2").arg(finfo.fileName()).arg(gzipDevice.errorString()));
+							outputFile.remove();
+						} else {
+							batchProcessor->writeHeader(output, tess->get(), pageData.pageInfo);
+						}
 					}
 				}
 			}
@@ -398,7 +417,7 @@ void Recognizer::recognizeBatch() {
 					tess->get()->Recognize(&monitor.desc);
 
 					if (!monitor.cancelled()) {
-						batchProcessor->appendOutput(&outputFile, tess->get(), pageData.pageInfo, firstChunk);
+						batchProcessor->appendOutput(output, tess->get(), pageData.pageInfo, firstChunk);
 					}
 					firstChunk = false;
 				}
@@ -410,7 +429,8 @@ void Recognizer::recognizeBatch() {
 			}
 		}
 		if (outputFile.isOpen()) {
-			batchProcessor->writeFooter(&outputFile);
+			batchProcessor->writeFooter(output);
+			gzipDevice.close();
 			outputFile.close();
 		}
 		return true;
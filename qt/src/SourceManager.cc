@@ -134,7 +134,7 @@ int SourceManager::addSources(const QStringList& files, bool suppressWarnings) {
 		if (m_watchedDirectories[finfo.absolutePath()] == 1) {
 			m_fsWatcher.addPath(finfo.absolutePath());
 		}
-		if (QFile(base + ".txt").exists() || QFile(base + ".html").exists()) {
+		if (QFile(base + ".txt").exists() || QFile(base + ".html").exists() || QFile(base + ".html.gz").exists()) {
 			m_fileTreeModel->setFileEditable(index, true);
 		}
 		sel.select(index, index);
@@ -472,18 +472,20 @@ void SourceManager::indexClicked(const QModelIndex& index) {
 		QFileInfo finfo(source->path);
 		QString base = finfo.absoluteDir().absoluteFilePath(finfo.baseName());
 		bool hasTxt = QFile(base + ".txt").exists();
-		bool hasHtml = QFile(base + ".html").exists();
+		// Batch mode writes compressed hOCR output if requested
+		QString htmlFile = QFile(base + ".html").exists() ? base + ".html" : base + ".html.gz";
+		bool hasHtml = QFile(htmlFile).exists();
 		if (hasTxt && hasHtml) {
 			QMessageBox box(QMessageBox::Question, _("Open output"), _("Both a text and a hOCR output were found. Which one do you want to open?"), QMessageBox::Cancel);
 			QAbstractButton* textButton = box.addButton(_("Text"), QMessageBox::AcceptRole);
 			QAbstractButton* hocrButton = box.addButton(_("hOCR"), QMessageBox::AcceptRole);
 			connect(textButton, &QAbstractButton::clicked, this, [base] { MAIN->openOutput(base + ".txt"); });
-			connect(hocrButton, &QAbstractButton::clicked, this, [base] { MAIN->openOutput(base + ".html"); });
+			connect(hocrButton, &QAbstractButton::clicked, this, [htmlFile] { MAIN->openOutput(htmlFile); });
 			box.exec();
 		} else if (hasTxt) {
 			MAIN->openOutput(base + ".txt");
 		} else if (hasHtml) {
-			MAIN->openOutput(base + ".html");
+			MAIN->openOutput(htmlFile);
 		}
 	}
 }
@@ -519,7 +521,7 @@ void SourceManager::directoryChanged(const QString& dir) {
 		if (source) {
 			QFileInfo finfo(source->path);
 			QString base = finfo.absoluteDir().absoluteFilePath(finfo.baseName());
-			m_fileTreeModel->setFileEditable(child, QFile(base + ".txt").exists() || QFile(base + ".html").exists());
+			m_fileTreeModel->setFileEditable(child, QFile(base + ".txt").exists() || QFile(base + ".html").exists() || QFile(base + ".html.gz").exists());
 		}
 	}
 }
@@ -0,0 +1,148 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * ThumbnailModel.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QListView>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+#include <cstdlib>
+
+#include "common.hh"
+#include "ThumbnailModel.hh"
+
+
+ThumbnailModel::ThumbnailModel(QListView* view, const Renderer& renderer, QObject* parent)
+	: QAbstractListModel(parent), m_view(view), m_renderer(renderer), m_placeholder(":/icons/thumbnail") {
+	// Keep at most a few screenfuls of thumbnails around
+	m_cache.setMaxCost(512);
+	m_maxRunning = std::max(1, QThread::idealThreadCount() - 1);
+	// Coalesce requests, so that rows which are merely scrolled past are never rendered
+	m_dispatchTimer.setSingleShot(true);
+	m_dispatchTimer.setInterval(50);
+	connect(&m_dispatchTimer, &QTimer::timeout, this, &ThumbnailModel::dispatch);
+}
+
+ThumbnailModel::~ThumbnailModel() {
+	m_dispatchTimer.stop();
+	waitForRunning();
+}
+
+void ThumbnailModel::setPageCount(int nPages) {
+	m_dispatchTimer.stop();
+	waitForRunning();
+	beginResetModel();
+	m_pageCount = nPages;
+	m_currentRow = 0;
+	m_pending.clear();
+	m_cache.clear();
+	endResetModel();
+}
+
+void ThumbnailModel::appendPages(int nPages) {
+	if (nPages > 0) {
+		beginInsertRows(QModelIndex(), m_pageCount, m_pageCount + nPages - 1);
+		m_pageCount += nPages;
+		endInsertRows();
+	}
+}
+
+void ThumbnailModel::setCurrentPage(int page) {
+	m_currentRow = page - 1;
+	if (!m_pending.isEmpty()) {
+		m_dispatchTimer.start();
+	}
+}
+
+QVariant ThumbnailModel::data(const QModelIndex& index, int role) const {
+	if (!index.isValid() || index.row() >= m_pageCount) {
+		return QVariant();
+	}
+	if (role == Qt::DisplayRole) {
+		return _("Page %1").arg(index.row() + 1);
+	} else if (role == Qt::DecorationRole) {
+		// The view only queries the decoration of rows it is about to paint
+		const QPixmap* pixmap = m_cache.object(index.row());
+		if (!pixmap) {
+			requestThumbnail(index.row());
+			return m_placeholder;
+		}
+		return pixmap->isNull() ? QVariant(m_placeholder) : QVariant(*pixmap);
+	}
+	return QVariant();
+}
+
+int ThumbnailModel::rowCount(const QModelIndex& parent) const {
+	return parent.isValid() ? 0 : m_pageCount;
+}
+
+void ThumbnailModel::requestThumbnail(int row) const {
+	if (!m_running.contains(row) && !m_pending.contains(row)) {
+		m_pending.append(row);
+	}
+	if (!m_dispatchTimer.isActive()) {
+		m_dispatchTimer.start();
+	}
+}
+
+void ThumbnailModel::dispatch() {
+	// Drop requests for rows which were scrolled out of view in the meantime
+	m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [this](int row) {
+		return row >= m_pageCount || m_cache.contains(row) || !isNearViewport(row);
+	}), m_pending.end());
+	// Render the rows closest to the current page first
+	std::stable_sort(m_pending.begin(), m_pending.end(), [this](int a, int b) {
+		return std::abs(a - m_currentRow) < std::abs(b - m_currentRow);
+	});
+	while (m_running.size() < m_maxRunning && !m_pending.isEmpty()) {
+		int row = m_pending.takeFirst();
+		QFutureWatcher<QImage>* watcher = new QFutureWatcher<QImage>();
+		connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, row] {
+			m_running.remove(row);
+			QImage image = watcher->result();
+			watcher->deleteLater();
+			// Also cache failed renders (as null pixmap), so that they are not retried on every repaint
+			m_cache.insert(row, new QPixmap(image.isNull() ? QPixmap() : QPixmap::fromImage(image)));
+			QModelIndex idx = index(row);
+			emit dataChanged(idx, idx, {Qt::DecorationRole});
+			dispatch();
+		});
+		Renderer renderer = m_renderer;
+		watcher->setFuture(QtConcurrent::run([renderer, row] { return renderer(row + 1); }));
+		m_running.insert(row, watcher);
+	}
+}
+
+void ThumbnailModel::waitForRunning() {
+	for (QFutureWatcher<QImage>* watcher : m_running) {
+		watcher->disconnect(this);
+		watcher->waitForFinished();
+		delete watcher;
+	}
+	m_running.clear();
+}
+
+bool ThumbnailModel::isNearViewport(int row) const {
+	if (!m_view->isVisible()) {
+		return false;
+	}
+	// Also prefetch one viewport height above and below the visible area
+	QRect rect = m_view->viewport()->rect();
+	rect.adjust(0, -rect.height(), 0, rect.height());
+	return m_view->visualRect(index(row)).intersects(rect);
+}
@@ -0,0 +1,74 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * ThumbnailModel.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILMODEL_HH
+#define THUMBNAILMODEL_HH
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QFutureWatcher>
+#include <QIcon>
+#include <QImage>
+#include <QMap>
+#include <QPixmap>
+#include <QTimer>
+#include <functional>
+
+class QListView;
+
+/**
+ * Lazy thumbnail model: thumbnails are only rendered once the view requests
+ * them (i.e. when the row becomes visible). Pending requests for rows which
+ * were scrolled out of view are dropped, and the remaining ones are rendered
+ * closest-to-the-current-page first.
+ */
+class ThumbnailModel : public QAbstractListModel {
+public:
+	typedef std::function<QImage(int) > Renderer;
+
+	ThumbnailModel(QListView* view, const Renderer& renderer, QObject* parent = nullptr);
+	~ThumbnailModel();
+
+	void setPageCount(int nPages);
+	// Adds rows for pages which became known after the count was set
+	void appendPages(int nPages);
+	void setCurrentPage(int page);
+
+	QVariant data(const QModelIndex& index, int role) const override;
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+
+private:
+	QListView* m_view;
+	Renderer m_renderer;
+	int m_pageCount = 0;
+	int m_currentRow = 0;
+	int m_maxRunning = 1;
+	QIcon m_placeholder;
+	mutable QCache<int, QPixmap> m_cache;
+	mutable QList<int> m_pending;
+	mutable QTimer m_dispatchTimer;
+	QMap<int, QFutureWatcher<QImage>*> m_running;
+
+	void requestThumbnail(int row) const;
+	void dispatch();
+	void waitForRunning();
+	bool isNearViewport(int row) const;
+};
+
+#endif // THUMBNAILMODEL_HH
@@ -100,18 +100,24 @@ public:
 	}
 };
 
-bool Utils::busyTask(const std::function<bool() >& f, const QString& msg) {
+Utils::BusyScope::BusyScope(const QString& msg)
+	: m_eventFilter(new BusyEventFilter) {
 	MAIN->pushState(MainWindow::State::Busy, msg);
+	QApplication::instance()->installEventFilter(m_eventFilter.get());
+}
+
+Utils::BusyScope::~BusyScope() {
+	QApplication::instance()->removeEventFilter(m_eventFilter.get());
+	MAIN->popState();
+}
+
+bool Utils::busyTask(const std::function<bool() >& f, const QString& msg) {
+	BusyScope busy(msg);
 	QEventLoop evLoop;
 	BusyTaskThread thread(f);
 	QObject::connect(&thread, &QThread::finished, &evLoop, &QEventLoop::quit);
 	thread.start();
-	BusyEventFilter filter;
-	QApplication::instance()->installEventFilter(&filter);
 	evLoop.exec();
-	QApplication::instance()->removeEventFilter(&filter);
-
-	MAIN->popState();
 	return thread.getResult();
 }
 
@@ -309,20 +315,109 @@ QDialogButtonBox::StandardButton Utils::messageBox(QWidget* parent, const QStrin
 }
 
 QString Utils::removeDiacritics(const QString& string) {
-	static QString diacriticLetters_ = QString::fromUtf8("ŠŒŽšœžŸ¥µÀÁÂÃÄÅÆÇÈÉÊËÌÍÎÏÐÑÒÓÔÕÖØÙÚÛÜÝßàáâãäåæçèéêëìíîïðñòóôõöøùúûüýÿſ");
-	static QStringList noDiacriticLetters_ = QStringList() << "S" << "OE" << "Z" << "s" << "oe" << "z" << "Y" << "Y" << "u" << "A" << "A" << "A" << "A" << "A" << "A" << "AE" << "C" << "E" << "E" << "E" << "E" << "I" << "I" << "I" << "I" << "D" << "N" << "O" << "O" << "O" << "O" << "O" << "O" << "U" << "U" << "U" << "U" << "Y" << "s" << "a" << "a" << "a" << "a" << "a" << "a" << "ae" << "c" << "e" << "e" << "e" << "e" << "i" << "i" << "i" << "i" << "o" << "n" << "o" << "o" << "o" << "o" << "o" << "o" << "u" << "u" << "u" << "u" << "y" << "y" << "s";
-
-	QString output = "";
-	for (int i = 0; i < string.length(); i++) {
-		QChar c = string[i];
-		int dIndex = diacriticLetters_.indexOf(c);
-		if (dIndex < 0) {
-			output.append(c);
+	// Replacements indexed by UTF-16 code unit, a null string if the character is kept
+	static const QVector<QString> replacements = [] {
+		QString diacriticLetters = QString::fromUtf8("ŠŒŽšœžŸ¥µÀÁÂÃÄÅÆÇÈÉÊËÌÍÎÏÐÑÒÓÔÕÖØÙÚÛÜÝßàáâãäåæçèéêëìíîïðñòóôõöøùúûüýÿſ");
+		QStringList noDiacriticLetters = QStringList() << "S" << "OE" << "Z" << "s" << "oe" << "z" << "Y" << "Y" << "u" << "A" << "A" << "A" << "A" << "A" << "A" << "AE" << "C" << "E" << "E" << "E" << "E" << "I" << "I" << "I" << "I" << "D" << "N" << "O" << "O" << "O" << "O" << "O" << "O" << "U" << "U" << "U" << "U" << "Y" << "s" << "a" << "a" << "a" << "a" << "a" << "a" << "ae" << "c" << "e" << "e" << "e" << "e" << "i" << "i" << "i" << "i" << "o" << "n" << "o" << "o" << "o" << "o" << "o" << "o" << "u" << "u" << "u" << "u" << "y" << "y" << "s";
+		QVector<QString> table;
+		for (int i = 0, n = diacriticLetters.length(); i < n; ++i) {
+			ushort c = diacriticLetters[i].unicode();
+			if (table.size() <= c) {
+				table.resize(c + 1);
+			}
+			table[c] = noDiacriticLetters[i];
+		}
+		return table;
+	}();
+	auto replacement = [](QChar c) -> const QString* {
+		return c.unicode() < replacements.size() && !replacements[c.unicode()].isNull() ? &replacements[c.unicode()] : nullptr;
+	};
+
+	// Strings without diacritics are returned without copying
+	int i = 0, n = string.length();
+	while (i < n && !replacement(string[i])) {
+		++i;
+	}
+	if (i == n) {
+		return string.isNull() ? QString("") : string;
+	}
+	QString output;
+	output.reserve(n + 8);
+	output.append(string.constData(), i);
+	for (; i < n; ++i) {
+		if (const QString* r = replacement(string[i])) {
+			output.append(*r);
 		} else {
-			QString replacement = noDiacriticLetters_[dIndex];
-			output.append(replacement);
+			output.append(string[i]);
 		}
 	}
-
 	return output;
 }
+
+Utils::MultiPatternMatcher::MultiPatternMatcher(const QStringList& patterns, Qt::CaseSensitivity cs) : m_cs(cs) {
+	// Build the trie of the patterns
+	m_nodes.append(Node());
+	for (const QString& pattern : patterns) {
+		int state = 0;
+		for (QChar c : pattern) {
+			if (m_cs == Qt::CaseInsensitive) {
+				c = c.toCaseFolded();
+			}
+			auto it = m_nodes[state].next.constFind(c);
+			if (it == m_nodes[state].next.constEnd()) {
+				m_nodes[state].next.insert(c, m_nodes.size());
+				state = m_nodes.size();
+				m_nodes.append(Node());
+			} else {
+				state = it.value();
+			}
+		}
+		m_nodes[state].match = true;
+	}
+	// Compute the failure links breadth first, a node matches if any of its suffixes does
+	QQueue<int> queue;
+	for (int child : m_nodes[0].next) {
+		queue.enqueue(child);
+	}
+	while (!queue.isEmpty()) {
+		int state = queue.dequeue();
+		for (auto it = m_nodes[state].next.constBegin(), itEnd = m_nodes[state].next.constEnd(); it != itEnd; ++it) {
+			int child = it.value();
+			int fail = m_nodes[state].fail;
+			while (fail != 0 && !m_nodes[fail].next.contains(it.key())) {
+				fail = m_nodes[fail].fail;
+			}
+			fail = m_nodes[fail].next.value(it.key(), 0);
+			m_nodes[child].fail = fail != child ? fail : 0;
+			m_nodes[child].match = m_nodes[child].match || m_nodes[m_nodes[child].fail].match;
+			queue.enqueue(child);
+		}
+	}
+}
+
+int Utils::MultiPatternMatcher::step(int state, QChar c) const {
+	while (true) {
+		auto it = m_nodes[state].next.constFind(c);
+		if (it != m_nodes[state].next.constEnd()) {
+			return it.value();
+		}
+		if (state == 0) {
+			return 0;
+		}
+		state = m_nodes[state].fail;
+	}
+}
+
+bool Utils::MultiPatternMatcher::containsAny(const QString& text) const {
+	int state = 0;
+	if (m_nodes[state].match) {
+		return true;
+	}
+	for (QChar c : text) {
+		state = step(state, m_cs == Qt::CaseInsensitive ? c.toCaseFolded() : c);
+		if (m_nodes[state].match) {
+			return true;
+		}
+	}
+	return false;
+}
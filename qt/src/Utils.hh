@@ -23,10 +23,13 @@
 #include <functional>
 #include <memory>
 #include <QDialogButtonBox>
+#include <QHash>
 #include <QMessageBox>
 #include <QMutex>
 #include <QQueue>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 #include <QWaitCondition>
 
 class QMimeData;
@@ -48,6 +51,16 @@ QString makeOutputFilename(const QString& filename);
 
 bool busyTask(const std::function<bool() >& f, const QString& msg);
 
+// Sets the busy state and blocks user input except for the progress cancel button while in scope,
+// for tasks which run on the main thread and process events in between, see busyTask
+class BusyScope {
+public:
+	BusyScope(const QString& msg);
+	~BusyScope();
+private:
+	std::unique_ptr<QObject> m_eventFilter;
+};
+
 void setSpinBlocked(QSpinBox* spin, int value);
 void setSpinBlocked(QDoubleSpinBox* spin, double value);
 
@@ -71,6 +84,24 @@ QDialogButtonBox::StandardButton messageBox(QWidget* parent, const QString& titl
 
 QString removeDiacritics(const QString& string);
 
+// Aho-Corasick automaton which finds whether a text contains any of a set of patterns in a single scan
+class MultiPatternMatcher {
+public:
+	MultiPatternMatcher(const QStringList& patterns, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+	bool containsAny(const QString& text) const;
+
+private:
+	struct Node {
+		QHash<QChar, int> next;
+		int fail = 0;
+		bool match = false;
+	};
+	QVector<Node> m_nodes;
+	Qt::CaseSensitivity m_cs;
+
+	int step(int state, QChar c) const;
+};
+
 template<typename T>
 class AsyncQueue {
 public:
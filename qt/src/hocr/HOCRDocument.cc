@@ -17,37 +17,78 @@
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QBuffer>
 #include <QDir>
 #include <QDomElement>
 #include <QFileInfo>
+#include <QHash>
 #include <QMenu>
 #include <QIcon>
+#include <QIODevice>
+#include <QMutex>
+#include <QReadWriteLock>
 #include <QSet>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
 
 #include "common.hh"
 #include "HOCRDocument.hh"
+#include "HOCRProject.hh"
+#include "HOCRReader.hh"
 #include "HOCRSpellChecker.hh"
 #include "Utils.hh"
 
 
 HOCRDocument::HOCRDocument(QObject* parent)
 	: QAbstractItemModel(parent) {
-	m_spell = new HOCRSpellChecker(this);
+	m_spell = new HOCRSpellCheckerPool();
+
+	m_spellCheckTimer.setSingleShot(true);
+	m_spellCheckTimer.setInterval(0);
+	connect(&m_spellCheckTimer, &QTimer::timeout, this, &HOCRDocument::startSpellCheckBatch);
+	connect(&m_spellCheckWatcher, &QFutureWatcher<void>::finished, this, &HOCRDocument::spellCheckBatchFinished);
+
+	m_pageNumberingTimer.setSingleShot(true);
+	m_pageNumberingTimer.setInterval(s_pageUpdateInterval);
+	connect(&m_pageNumberingTimer, &QTimer::timeout, this, &HOCRDocument::updatePageNumbering);
+	m_pageBatchTimer.setInterval(s_pageUpdateInterval);
+	connect(&m_pageBatchTimer, &QTimer::timeout, this, &HOCRDocument::flushPendingPages);
+
+	QTimer* evictionTimer = new QTimer(this);
+	connect(evictionTimer, &QTimer::timeout, this, &HOCRDocument::evictIdlePages);
+	evictionTimer->start(s_evictionInterval);
 }
 
 HOCRDocument::~HOCRDocument() {
+	m_spellCheckWatcher.waitForFinished();
+	delete m_spell;
+	qDeleteAll(m_pendingPages);
 	qDeleteAll(m_pages);
 }
 
 void HOCRDocument::clear() {
 	beginResetModel();
+	qDeleteAll(m_pendingPages);
+	m_pendingPages.clear();
 	qDeleteAll(m_pages);
 	m_pages.clear();
+	m_wordIndex.clear();
 	m_pageIdCounter = 0;
 	endResetModel();
 }
 
+void HOCRDocument::clearSpellCache() {
+	QMutexLocker locker(&m_spellCacheMutex);
+	m_spellCache.clear();
+	++m_spellCacheGeneration;
+}
+
 void HOCRDocument::resetMisspelled(const QModelIndex& index) {
 	if (hasChildren(index)) {
 		for (int i = 0, n = rowCount(index); i < n; ++i) {
@@ -63,6 +104,7 @@ void HOCRDocument::addSpellingActions(QMenu* menu, const QModelIndex& index) {
 	QStringList suggestions;
 	QString trimmedWord;
 	bool valid = getItemSpellingSuggestions(index, trimmedWord, suggestions, 16);
+	QString lang = itemAtIndex(index) ? itemAtIndex(index)->spellingLang() : QString();
 	for (const QString& suggestion : suggestions) {
 		menu->addAction(suggestion, menu, [this, suggestion, index] { setData(index, suggestion, Qt::EditRole); });
 	}
@@ -72,12 +114,14 @@ void HOCRDocument::addSpellingActions(QMenu* menu, const QModelIndex& index) {
 		}
 		if (!valid) {
 			menu->addSeparator();
-			menu->addAction(_("Add to dictionary"), menu, [this, trimmedWord, index] {
-				m_spell->addWordToDictionary(trimmedWord);
+			menu->addAction(_("Add to dictionary"), menu, [this, lang, trimmedWord, index] {
+				m_spell->addWordToDictionary(lang, trimmedWord);
+				clearSpellCache();
 				resetMisspelled(index);
 			});
-			menu->addAction(_("Ignore word"), menu, [this, trimmedWord, index] {
-				m_spell->ignoreWord(trimmedWord);
+			menu->addAction(_("Ignore word"), menu, [this, lang, trimmedWord, index] {
+				m_spell->ignoreWord(lang, trimmedWord);
+				clearSpellCache();
 				resetMisspelled(index);
 			});
 		}
@@ -88,35 +132,215 @@ void HOCRDocument::addWordToDictionary(const QModelIndex& index) {
 	const HOCRItem* item = itemAtIndex(index);
 	if (item && item->isMisspelled()) {
 		QString trimmedWord = HOCRItem::trimmedWord(item->text());
-		m_spell->addWordToDictionary(trimmedWord);
+		m_spell->addWordToDictionary(item->spellingLang(), trimmedWord);
+		clearSpellCache();
 		resetMisspelled(index);
 	}
 }
 
-QString HOCRDocument::toHTML() const {
-	QString html = "<body>\n";
-	for (const HOCRPage* page : m_pages) {
-		html += page->toHtml(1);
+bool HOCRDocument::writeHTML(QIODevice* device) const {
+	// Only one page is held in serialized form at a time
+	if (device->write("<body>\n") < 0) {
+		return false;
+	}
+	QString html;
+	for (int i = 0, n = m_pages.size(); i < n; ++i) {
+		html.clear();
+		writePageHtml(i, html);
+		if (device->write(html.toUtf8()) < 0) {
+			return false;
+		}
+	}
+	return device->write("</body>\n") >= 0;
+}
+
+bool HOCRDocument::writeProject(QIODevice* device) const {
+	HOCRProjectWriter writer(device);
+	for (HOCRPage* page : m_pages) {
+		bool loaded = page->m_loaded.loadAcquire();
+		bool success = writer.writePage(page);
+		if (!loaded) {
+			page->unload();
+		}
+		if (!success) {
+			return false;
+		}
+	}
+	return writer.finish();
+}
+
+void HOCRDocument::releaseProject(const QString& filename) {
+#ifdef Q_OS_WIN
+	// Mapped files cannot be replaced on Windows. Copying the file to memory is still much cheaper than
+	// constructing the items of all pages, and the pages are read from the saved project again afterwards.
+	QString path = QFileInfo(filename).absoluteFilePath();
+	QSet<HOCRProject*> released;
+	for (HOCRPage* page : m_pages) {
+		if (page->m_project && !released.contains(page->m_project.data()) && QFileInfo(page->m_project->fileName()).absoluteFilePath() == path) {
+			page->m_project->release();
+			released.insert(page->m_project.data());
+		}
+	}
+#else
+	// Replacing the file by renaming leaves the mapped contents intact
+	Q_UNUSED(filename);
+#endif
+}
+
+void HOCRDocument::attachProject(const QSharedPointer<HOCRProject>& project) {
+	if (project->pageCount() != m_pages.size()) {
+		return;
+	}
+	for (int i = 0, n = m_pages.size(); i < n; ++i) {
+		m_pages[i]->setProject(project, i);
+	}
+}
+
+void HOCRDocument::writePageHtml(int i, QString& html) const {
+	HOCRPage* page = m_pages[i];
+	bool loaded = page->m_loaded.loadAcquire();
+	page->writeHtml(html, 1);
+	// Don't keep pages in memory which were only loaded for serializing them
+	if (!loaded) {
+		page->unload();
+	}
+}
+
+void HOCRDocument::writePageChildrenHtml(int i, QString& html) const {
+	HOCRPage* page = m_pages[i];
+	bool loaded = page->m_loaded.loadAcquire();
+	for (const HOCRItem* child : page->children()) {
+		child->writeHtml(html, 2);
+	}
+	if (!loaded) {
+		page->unload();
 	}
-	html += "</body>\n";
-	return html;
 }
 
 
 QModelIndex HOCRDocument::insertPage(int beforeIdx, const QDomElement& pageElement, bool cleanGraphics, const QString& sourceBasePath) {
-	beginInsertRows(QModelIndex(), beforeIdx, beforeIdx);
-	m_pages.insert(beforeIdx, new HOCRPage(pageElement, ++m_pageIdCounter, m_defaultLanguage, cleanGraphics, beforeIdx));
+	return insertPageItem(beforeIdx, new HOCRPage(pageElement, ++m_pageIdCounter, m_defaultLanguage, cleanGraphics, beforeIdx), sourceBasePath);
+}
+
+QModelIndex HOCRDocument::insertPage(int beforeIdx, const QDomElement& pageElement, const QByteArray& pageXml, int childCount, const HOCRPageWords& words, const QString& sourceBasePath) {
+	return insertPageItem(beforeIdx, new HOCRPage(pageElement, pageXml, childCount, words, ++m_pageIdCounter, m_defaultLanguage, beforeIdx), sourceBasePath);
+}
+
+QModelIndex HOCRDocument::insertPage(int beforeIdx, const QSharedPointer<HOCRProject>& project, int projectPage, const QString& sourceBasePath) {
+	return insertPageItem(beforeIdx, new HOCRPage(project, projectPage, ++m_pageIdCounter, m_defaultLanguage, beforeIdx), sourceBasePath);
+}
+
+bool HOCRDocument::insertPages(int beforeIdx, const QByteArray& data, const QVector<QPair<int, int>>& pages, const QString& sourceBasePath, const std::function<bool(int pagesRead)>& progress, int& inserted) {
+	struct ParsedPage {
+		QByteArray data;
+		int pageId;
+		HOCRPage* page;
+	};
+	QString defaultLanguage = m_defaultLanguage;
+	int batchSize = s_parseBatchSize * QThread::idealThreadCount();
+	bool success = true;
+	inserted = 0;
+	beginInsertPages();
+	for (int start = 0, n = pages.size(); start < n && success; start += batchSize) {
+		QVector<ParsedPage> batch;
+		for (int i = start, end = qMin(start + batchSize, n); i < end; ++i) {
+			batch.append(ParsedPage{QByteArray::fromRawData(data.constData() + pages[i].first, pages[i].second - pages[i].first), ++m_pageIdCounter, nullptr});
+		}
+		// Pages are independent, so they can be parsed into detached page items concurrently
+		QtConcurrent::blockingMap(batch, [&defaultLanguage](ParsedPage& parsed) {
+			QBuffer buffer(&parsed.data);
+			buffer.open(QIODevice::ReadOnly);
+			HOCRReader reader(&buffer);
+			QByteArray pageXml;
+			int childCount = 0;
+			HOCRPageWords words;
+			QDomElement div = reader.readPageFragment(pageXml, childCount, words);
+			if (!div.isNull()) {
+				parsed.page = new HOCRPage(div, pageXml, childCount, words, parsed.pageId, defaultLanguage, 0);
+			}
+		});
+		for (const ParsedPage& parsed : batch) {
+			// As when reading the document sequentially, the first div needs to be a page
+			if (!success || !parsed.page || (start == 0 && inserted == 0 && parsed.page->itemClassId() != HOCRItem::ItemClass::Page)) {
+				delete parsed.page;
+				success = false;
+				continue;
+			}
+			insertPageItem(beforeIdx + inserted++, parsed.page, sourceBasePath);
+		}
+		if (success && !progress(start + batch.size())) {
+			break;
+		}
+	}
+	endInsertPages();
+	return success;
+}
+
+QModelIndex HOCRDocument::insertPageItem(int beforeIdx, HOCRPage* page, const QString& sourceBasePath) {
 	if (!sourceBasePath.isEmpty()) {
-		m_pages[beforeIdx]->convertSourcePath(sourceBasePath, true);
+		page->convertSourcePath(sourceBasePath, true);
+	}
+	if (m_pageBatchDepth > 0) {
+		// Consecutive pages are collected and inserted together
+		if (!m_pendingPages.isEmpty() && beforeIdx != m_pendingPagesPos + m_pendingPages.size()) {
+			flushPendingPages();
+		}
+		if (m_pendingPages.isEmpty()) {
+			m_pendingPagesPos = beforeIdx;
+		}
+		m_pendingPages.append(page);
+		return QModelIndex();
 	}
-	for (int i = beforeIdx + 1; i < m_pages.size(); ++i) {
+	beginInsertRows(QModelIndex(), beforeIdx, beforeIdx);
+	m_pages.insert(beforeIdx, page);
+	m_wordIndex.addPage(page);
+	for (int i = beforeIdx; i < m_pages.size(); ++i) {
 		m_pages[i]->m_index = i;
 	}
 	endInsertRows();
-	emit dataChanged(index(0, 0), index(m_pages.size() - 1, 0), {Qt::DisplayRole});
+	// The page titles include the page count
+	m_pageNumberingTimer.start();
 	return index(beforeIdx, 0);
 }
 
+void HOCRDocument::beginInsertPages() {
+	if (m_pageBatchDepth++ == 0) {
+		m_pageBatchTimer.start();
+	}
+}
+
+void HOCRDocument::endInsertPages() {
+	if (--m_pageBatchDepth == 0) {
+		m_pageBatchTimer.stop();
+		flushPendingPages();
+	}
+}
+
+void HOCRDocument::flushPendingPages() {
+	if (m_pendingPages.isEmpty()) {
+		return;
+	}
+	int pos = m_pendingPagesPos;
+	beginInsertRows(QModelIndex(), pos, pos + m_pendingPages.size() - 1);
+	m_pages.insert(pos, m_pendingPages.size(), nullptr);
+	for (int i = 0, n = m_pendingPages.size(); i < n; ++i) {
+		m_pages[pos + i] = m_pendingPages[i];
+		m_wordIndex.addPage(m_pendingPages[i]);
+	}
+	for (int i = pos, n = m_pages.size(); i < n; ++i) {
+		m_pages[i]->m_index = i;
+	}
+	m_pendingPages.clear();
+	endInsertRows();
+	m_pageNumberingTimer.start();
+}
+
+void HOCRDocument::updatePageNumbering() {
+	if (!m_pages.isEmpty()) {
+		emit dataChanged(index(0, 0), index(m_pages.size() - 1, 0), {Qt::DisplayRole});
+	}
+}
+
 QModelIndex HOCRDocument::indexAtItem(const HOCRItem* item) const {
 	QList<const HOCRItem*> parents;
 	const HOCRItem* parent = item->parent();
@@ -137,6 +361,7 @@ bool HOCRDocument::editItemAttribute(const QModelIndex& index, const QString& na
 		return false;
 	}
 
+	setPageModified(item);
 	item->setAttribute(name, value, attrItemClass);
 	if (name == "title:x_wconf") {
 		QModelIndex colIdx = index.sibling(index.row(), 1);
@@ -167,6 +392,10 @@ QModelIndex HOCRDocument::moveItem(const QModelIndex& itemIndex, const QModelInd
 		}
 		ancestor = ancestor.parent();
 	}
+	if (parentItem) {
+		setPageModified(item);
+		setPageModified(parentItem);
+	}
 	int oldRow = itemIndex.row();
 	QModelIndex oldParent = itemIndex.parent();
 	if (oldParent == newParent && oldRow < newRow) {
@@ -198,6 +427,7 @@ QModelIndex HOCRDocument::mergeItems(const QModelIndex& parent, int startRow, in
 	if (!targetItem || targetItem->itemClass() == "ocr_page") {
 		return QModelIndex();
 	}
+	setPageModified(targetItem);
 
 	QRect bbox = targetItem->bbox();
 	if (targetItem->itemClass() == "ocrx_word") {
@@ -212,7 +442,9 @@ QModelIndex HOCRDocument::mergeItems(const QModelIndex& parent, int startRow, in
 			deleteItem(item);
 		}
 		endRemoveRows();
+		m_wordIndex.removeWord(targetItem->page(), targetItem->text());
 		targetItem->setText(text);
+		m_wordIndex.addWord(targetItem->page(), text);
 		for (QModelIndex changedIndex : recheckItemSpelling(targetIndex)) {
 			emit dataChanged(changedIndex, changedIndex, {Qt::DisplayRole, Qt::ForegroundRole});
 		}
@@ -249,6 +481,7 @@ QModelIndex HOCRDocument::splitItem(const QModelIndex& itemIndex, int startRow,
 	if (!item) {
 		return QModelIndex();
 	}
+	setPageModified(item);
 	QString itemClass = item->itemClass();
 	QDomDocument doc;
 	QDomElement newElement;
@@ -287,6 +520,7 @@ QModelIndex HOCRDocument::splitItemText(const QModelIndex& itemIndex, int pos) {
 	if (pos == 0 || pos == item->text().length()) {
 		return itemIndex;
 	}
+	setPageModified(item);
 	// Compute new bounding box using font metrics with default font
 	QFontMetrics metrics((QFont()));
 	double fraction = metrics.horizontalAdvance(item->text().left(pos)) / double (metrics.horizontalAdvance(item->text()));
@@ -321,6 +555,7 @@ QModelIndex HOCRDocument::mergeItemText(const QModelIndex& itemIndex, bool merge
 	if ((!mergeNext && item->index() == 0) || (mergeNext && item->index() == item->parent()->children().size() - 1)) {
 		return QModelIndex();
 	}
+	setPageModified(item);
 	int offset = mergeNext ? 1 : -1;
 	HOCRItem* otherItem = item->parent()->children() [item->index() + offset];
 	QString newText = mergeNext ? item->text() + otherItem->text() : otherItem->text() + item->text();
@@ -338,10 +573,13 @@ QModelIndex HOCRDocument::addItem(const QModelIndex& parent, const QDomElement&
 	if (!parentItem) {
 		return QModelIndex();
 	}
+	setPageModified(parentItem);
 	HOCRItem* item = new HOCRItem(element, parentItem->page(), parentItem);
 	int pos = parentItem->children().size();
 	beginInsertRows(parent, pos, pos);
 	parentItem->addChild(item);
+	item->page()->m_spatialIndex.insert(item);
+	indexWords(item->page(), item, true);
 	recomputeBBoxes(parentItem);
 	endInsertRows();
 	return index(pos, 0, parent);
@@ -353,6 +591,9 @@ bool HOCRDocument::removeItem(const QModelIndex& index) {
 		return false;
 	}
 	HOCRItem* parentItem = item->parent();
+	if (parentItem) {
+		setPageModified(parentItem);
+	}
 	beginRemoveRows(index.parent(), index.row(), index.row());
 	deleteItem(item);
 	endRemoveRows();
@@ -410,10 +651,26 @@ QModelIndex HOCRDocument::prevOrNextIndex(bool next, const QModelIndex& current,
 	if (!start.isValid()) {
 		start = index(0, 0);
 	}
+	if (!start.isValid()) {
+		return start;
+	}
+	const HOCRPage* startPage = itemAtIndex(start)->page();
+	bool skipPages = ocrClass == "ocrx_word" && (misspelled || lowconf);
+	const HOCRPage* currPage = startPage;
 	QModelIndex curr = next ? nextIndex(start) : prevIndex(start);
 	while (curr != start) {
+		// Pages are entered at their page item going forward, and at their last item going backward.
+		// Skip pages which are known not to contain any matching word, except for the starting page.
+		const HOCRPage* page = itemAtIndex(curr)->page();
+		if (skipPages && page != currPage && page != startPage && !pageMayContainMatches(page, misspelled, lowconf)) {
+			QModelIndex pageIndex = index(page->index(), 0);
+			curr = next ? index((page->index() + 1) % m_pages.size(), 0) : prevIndex(pageIndex);
+			currPage = page;
+			continue;
+		}
+		currPage = page;
 		const HOCRItem* item = itemAtIndex(curr);
-		if (item && item->itemClass() == ocrClass && (!misspelled || indexIsMisspelledWord(curr)) && (!lowconf || item->getTitleAttributes() ["x_wconf"].toInt() < 90)) {
+		if (item && item->itemClass() == ocrClass && (!misspelled || indexIsMisspelledWord(curr)) && (!lowconf || item->wordConfidence() < 90)) {
 			break;
 		}
 		curr = next ? nextIndex(curr) : prevIndex(curr);
@@ -421,6 +678,47 @@ QModelIndex HOCRDocument::prevOrNextIndex(bool next, const QModelIndex& current,
 	return curr;
 }
 
+bool HOCRDocument::pageMayContainMatches(const HOCRPage* page, bool misspelled, bool lowconf) const {
+	// Pages which are not loaded are unmodified, their low confidence count is known from when they were read
+	bool loaded = page->m_loaded.loadAcquire();
+	if (loaded) {
+		page->ensureWordStats();
+	}
+	if (lowconf && page->m_lowConfidenceWords == 0) {
+		return false;
+	}
+	if (!misspelled || (loaded && page->m_misspelledWords > 0)) {
+		return true;
+	}
+	if (loaded && page->m_uncheckedWords == 0) {
+		return false;
+	}
+	return pageWordsMisspelled(page);
+}
+
+bool HOCRDocument::pageWordsMisspelled(const HOCRPage* page) const {
+	const QHash<QString, QStringList>* words = page->spellingWords();
+	if (!words) {
+		return true;
+	}
+	// Hyphenated words are checked on their own, which only overestimates the misspelled words
+	for (auto it = words->begin(), itEnd = words->end(); it != itEnd; ++it) {
+		QString lang = Config::lookupLangCode(it.key());
+		if (lang.isEmpty()) {
+			lang = it.key();
+		}
+		if (lang.isEmpty()) {
+			continue;
+		}
+		for (const QString& word : it.value()) {
+			if (lookupSpelling(lang, word, true) == 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
 bool HOCRDocument::indexIsMisspelledWord(const QModelIndex& index) const {
 	const HOCRItem* item = itemAtIndex(index);
 	if (item->isMisspelled() == -1) {
@@ -429,7 +727,7 @@ bool HOCRDocument::indexIsMisspelledWord(const QModelIndex& index) const {
 	return item->isMisspelled() == 1;
 }
 
-QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index) const {
+QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index, bool wait) const {
 	HOCRItem* item = mutableItemAtIndex(index);
 	if (item->itemClass() != "ocrx_word") { return {}; }
 
@@ -439,13 +737,25 @@ QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index) c
 		return {index};
 	}
 	QString lang = item->spellingLang();
-	if (lang.isEmpty() || (m_spell->getLanguage() != lang && !(m_spell->setLanguage(lang)))) {
+	if (lang.isEmpty()) {
 		item->setMisspelled(false);
 		return {index};
 	}
 
+	// If not waiting, words which are not cached yet are queued for the background check,
+	// and the item is checked again once they have been looked up
+	auto defer = [this, item, index] {
+		item->setMisspelled(-1);
+		m_spellPending.insert(index);
+		m_spellCheckTimer.start();
+		return QList<QModelIndex>();
+	};
+
 	// check word, including (if requested) setting suggestions; handle hyphenated phrases correctly
-	if (m_spell->checkSpelling(trimmed)) {
+	int valid = lookupSpelling(lang, trimmed, wait);
+	if (valid == -1) {
+		return defer();
+	} else if (valid) {
 		item->setMisspelled(false);
 		return {index};
 	}
@@ -469,7 +779,10 @@ QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index) c
 		if (!prevText.endsWith("-")) { return {index}; }
 
 		// don't bother with (reassembled) suggestions for broken words since we can't re-break them
-		bool valid = m_spell->checkSpelling(HOCRItem::trimmedWord(prevText) + trimmed);
+		valid = lookupSpelling(lang, HOCRItem::trimmedWord(prevText) + trimmed, wait);
+		if (valid == -1) {
+			return defer();
+		}
 		item->setMisspelled(!valid);
 		prevWord->setMisspelled(!valid);
 		return {index, indexAtItem(prevWord) };
@@ -479,7 +792,10 @@ QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index) c
 		HOCRItem* nextWord = nextLine->children().front();
 		if (!nextWord || nextWord->itemClass() != "ocrx_word") { return {index}; }
 
-		bool valid = m_spell->checkSpelling(trimmed + HOCRItem::trimmedWord(nextWord->text()));
+		valid = lookupSpelling(lang, trimmed + HOCRItem::trimmedWord(nextWord->text()), wait);
+		if (valid == -1) {
+			return defer();
+		}
 		item->setMisspelled(!valid);
 		nextWord->setMisspelled(!valid);
 		return {index, indexAtItem(nextWord) };
@@ -487,6 +803,76 @@ QList<QModelIndex> HOCRDocument::recheckItemSpelling(const QModelIndex& index) c
 	return {index};
 }
 
+int HOCRDocument::lookupSpelling(const QString& lang, const QString& word, bool wait) const {
+	int generation;
+	{
+		QMutexLocker locker(&m_spellCacheMutex);
+		auto langIt = m_spellCache.constFind(lang);
+		if (langIt != m_spellCache.constEnd()) {
+			auto it = langIt.value().constFind(word);
+			if (it != langIt.value().constEnd()) {
+				return it.value();
+			}
+		}
+		if (!wait) {
+			QPair<QString, QString> key(lang, word);
+			if (!m_spellQueued.contains(key)) {
+				m_spellQueued.insert(key);
+				m_spellQueue.append(key);
+			}
+			return -1;
+		}
+		generation = m_spellCacheGeneration;
+	}
+	bool valid = m_spell->checkSpelling(lang, word);
+	QMutexLocker locker(&m_spellCacheMutex);
+	// Don't store results obtained before the dictionary was changed
+	if (generation == m_spellCacheGeneration) {
+		m_spellCache[lang].insert(word, valid);
+	}
+	return valid;
+}
+
+void HOCRDocument::startSpellCheckBatch() {
+	if (m_spellCheckWatcher.isRunning()) {
+		return;
+	}
+	QList<QPair<QString, QString>> batch;
+	{
+		QMutexLocker locker(&m_spellCacheMutex);
+		batch = m_spellQueue.mid(0, s_spellCheckBatchSize);
+		m_spellQueue.erase(m_spellQueue.begin(), m_spellQueue.begin() + batch.size());
+	}
+	if (batch.isEmpty()) {
+		return;
+	}
+	// Group the words by language, words of different languages are looked up in parallel
+	std::stable_sort(batch.begin(), batch.end(), [](const QPair<QString, QString>& a, const QPair<QString, QString>& b) { return a.first < b.first; });
+	m_spellCheckWatcher.setFuture(QtConcurrent::run([this, batch]() mutable {
+		QtConcurrent::blockingMap(batch, [this](const QPair<QString, QString>& key) {
+			lookupSpelling(key.first, key.second, true);
+		});
+		QMutexLocker locker(&m_spellCacheMutex);
+		for (const QPair<QString, QString>& key : batch) {
+			m_spellQueued.remove(key);
+		}
+	}));
+}
+
+void HOCRDocument::spellCheckBatchFinished() {
+	QSet<QPersistentModelIndex> pending;
+	std::swap(pending, m_spellPending);
+	QList<QModelIndex> changed;
+	for (const QPersistentModelIndex& index : pending) {
+		// Items which are still waiting for a word are queued again
+		if (index.isValid()) {
+			changed.append(recheckItemSpelling(index, false));
+		}
+	}
+	emitDataChanged(changed, {Qt::ForegroundRole});
+	startSpellCheckBatch();
+}
+
 bool HOCRDocument::getItemSpellingSuggestions(const QModelIndex& index, QString& trimmedWord, QStringList& suggestions, int limit) const {
 	const HOCRItem* item = itemAtIndex(index);
 	if (item->itemClass() != "ocrx_word") { return true; }
@@ -497,11 +883,11 @@ bool HOCRDocument::getItemSpellingSuggestions(const QModelIndex& index, QString&
 		return true;
 	}
 	QString lang = item->spellingLang();
-	if (m_spell->getLanguage() != lang && !(m_spell->setLanguage(lang))) {
+	if (lang.isEmpty()) {
 		return true;
 	}
 
-	bool valid = m_spell->checkSpelling(trimmedWord, &suggestions, limit);
+	bool valid = m_spell->checkSpelling(lang, trimmedWord, &suggestions, limit);
 	for (int i = 0, n = suggestions.size(); i < n; ++i) {
 		suggestions[i] = prefix + suggestions[i] + suffix;
 	}
@@ -533,19 +919,20 @@ QModelIndex HOCRDocument::searchAtCanvasPos(const QModelIndex& pageIndex, const
 		return QModelIndex();
 	}
 	const HOCRItem* item = itemAtIndex(idx);
+	QVector<const HOCRItem*> candidates = item->page()->spatialIndex().query(QRect(pos, QSize(1, 1)));
+	// At each level, descend into the first child containing the position
 	while (true) {
-		int iChild = 0, nChildren = item->children().size();
-		for (; iChild < nChildren; ++iChild) {
-			const HOCRItem* childItem = item->children() [iChild];
-			if (childItem->bbox().contains(pos)) {
-				item = childItem;
-				idx = index(iChild, 0, idx);
-				break;
+		const HOCRItem* childItem = nullptr;
+		for (const HOCRItem* candidate : candidates) {
+			if (candidate->parent() == item && candidate->bbox().contains(pos) && (!childItem || candidate->index() < childItem->index())) {
+				childItem = candidate;
 			}
 		}
-		if (iChild == nChildren) {
+		if (!childItem) {
 			break;
 		}
+		item = childItem;
+		idx = index(item->index(), 0, idx);
 	}
 	return idx;
 }
@@ -579,10 +966,15 @@ QVariant HOCRDocument::data(const QModelIndex& index, int role) const {
 				enabled = parent->isEnabled();
 				parent = parent->parent();
 			}
+			// Painting does not wait for the spelling to be checked, the item is updated once the check completes
+			if (item->isMisspelled() == -1) {
+				recheckItemSpelling(index, false);
+			}
+			bool misspelled = item->isMisspelled() == 1;
 			if (enabled) {
-				return indexIsMisspelledWord(index) ? QVariant(QColor(Qt::red)) : QVariant();
+				return misspelled ? QVariant(QColor(Qt::red)) : QVariant();
 			} else {
-				return indexIsMisspelledWord(index) ? QVariant(QColor(208, 80, 82)) : QVariant(QColor(Qt::gray));
+				return misspelled ? QVariant(QColor(208, 80, 82)) : QVariant(QColor(Qt::gray));
 			}
 		}
 		case Qt::CheckStateRole:
@@ -592,7 +984,7 @@ QVariant HOCRDocument::data(const QModelIndex& index, int role) const {
 		}
 	} else if (index.column() == 1) {
 		if (role == Qt::DisplayRole && item->itemClass() == "ocrx_word") {
-			return item->getTitleAttributes() ["x_wconf"];
+			return item->attrValue(HOCRItem::TitleAttrs, HOCRItem::KeyWConf);
 		}
 	}
 	return QVariant();
@@ -605,13 +997,17 @@ bool HOCRDocument::setData(const QModelIndex& index, const QVariant& value, int
 
 	HOCRItem* item = mutableItemAtIndex(index);
 	if (role == Qt::EditRole && item->itemClass() == "ocrx_word") {
+		setPageModified(item);
+		m_wordIndex.removeWord(item->page(), item->text());
 		item->setText(value.toString());
+		m_wordIndex.addWord(item->page(), item->text());
 		for (QModelIndex changedIndex : recheckItemSpelling(index)) {
 			emit dataChanged(changedIndex, changedIndex, {Qt::DisplayRole, Qt::ForegroundRole});
 		}
 
 		return true;
 	} else if (role == Qt::CheckStateRole) {
+		setPageModified(item);
 		item->setEnabled(value == Qt::Checked);
 		// Get leaf
 		QModelIndex leaf = index;
@@ -624,6 +1020,59 @@ bool HOCRDocument::setData(const QModelIndex& index, const QVariant& value, int
 	return false;
 }
 
+int HOCRDocument::replaceWordTexts(const QModelIndex& index, const std::function<bool(QString& text)>& replace) {
+	QList<QModelIndex> changed;
+	int count = 0;
+	replaceWordTexts(index, replace, changed, count);
+
+	emitDataChanged(changed, {Qt::DisplayRole, Qt::ForegroundRole});
+	return count;
+}
+
+void HOCRDocument::replaceWordTexts(const QModelIndex& index, const std::function<bool(QString& text)>& replace, QList<QModelIndex>& changed, int& count) {
+	HOCRItem* item = mutableItemAtIndex(index);
+	if (!item) {
+		return;
+	}
+	if (item->itemClass() == "ocrx_word") {
+		QString text = item->text();
+		if (!replace(text)) {
+			return;
+		}
+		++count;
+		if (text != item->text()) {
+			setPageModified(item);
+			m_wordIndex.removeWord(item->page(), item->text());
+			item->setText(text);
+			m_wordIndex.addWord(item->page(), item->text());
+			// Spelling of bulk replacements is checked in the background
+			changed.append(index);
+			changed.append(recheckItemSpelling(index, false));
+		}
+		return;
+	}
+	for (int row = 0, nRows = rowCount(index); row < nRows; ++row) {
+		replaceWordTexts(this->index(row, 0, index), replace, changed, count);
+	}
+}
+
+void HOCRDocument::emitDataChanged(const QList<QModelIndex>& indices, const QVector<int>& roles) {
+	// Group the items into row ranges per parent
+	QHash<QModelIndex, QPair<int, int>> ranges;
+	for (const QModelIndex& index : indices) {
+		auto it = ranges.find(index.parent());
+		if (it == ranges.end()) {
+			ranges.insert(index.parent(), qMakePair(index.row(), index.row()));
+		} else {
+			it.value().first = qMin(it.value().first, index.row());
+			it.value().second = qMax(it.value().second, index.row());
+		}
+	}
+	for (auto it = ranges.begin(), itEnd = ranges.end(); it != itEnd; ++it) {
+		emit dataChanged(this->index(it.value().first, 0, it.key()), this->index(it.value().second, 0, it.key()), roles);
+	}
+}
+
 void HOCRDocument::recomputeBBoxes(HOCRItem* item) {
 	// Update parent bboxes (except page)
 	while (item && item->parent()) {
@@ -685,6 +1134,54 @@ int HOCRDocument::columnCount(const QModelIndex& /*parent*/) const {
 	return 2;
 }
 
+bool HOCRDocument::hasChildren(const QModelIndex& parent) const {
+	const HOCRItem* item = itemAtIndex(parent);
+	if (item && !item->parent()) {
+		// Don't load the page just for deciding whether it is expandable
+		return parent.column() == 0 && static_cast<const HOCRPage*> (item)->childCount() > 0;
+	}
+	return QAbstractItemModel::hasChildren(parent);
+}
+
+void HOCRDocument::evictIdlePages() {
+	int tick = HOCRPage::advanceAccessTick();
+	if (m_evictionBlockers.loadAcquire() > 0) {
+		return;
+	}
+	// Pages referenced by views (current, selected or expanded items) must stay
+	QSet<const HOCRPage*> pinned;
+	for (const QModelIndex& index : persistentIndexList()) {
+		if (const HOCRItem* item = itemAtIndex(index)) {
+			pinned.insert(item->page());
+		}
+	}
+	for (HOCRPage* page : m_pages) {
+		if (!pinned.contains(page) && tick - page->m_lastAccess >= s_evictionTicks) {
+			page->unload();
+		}
+	}
+}
+
+void HOCRDocument::indexWords(HOCRPage* page, const HOCRItem* item, bool add) {
+	if (item->itemClassId() == HOCRItem::ItemClass::Word) {
+		if (add) {
+			m_wordIndex.addWord(page, item->text());
+		} else {
+			m_wordIndex.removeWord(page, item->text());
+		}
+	}
+	for (const HOCRItem* child : item->children()) {
+		indexWords(page, child, add);
+	}
+}
+
+void HOCRDocument::setPageModified(const HOCRItem* item) {
+	// Edited pages can't be restored from their serialized form anymore
+	item->page()->setModified();
+	item->page()->m_wordStatsValid = false;
+	emit pageModified(item->page()->pageId());
+}
+
 QString HOCRDocument::displayRoleForItem(const HOCRItem* item) const {
 	QString itemClass = item->itemClass();
 	if (itemClass == "ocr_page") {
@@ -738,13 +1235,16 @@ QString HOCRDocument::tooltipRoleForItem(const HOCRItem* item) const {
 void HOCRDocument::insertItem(HOCRItem* parent, HOCRItem* item, int i) {
 	if (parent) {
 		parent->insertChild(item, i);
+		parent->page()->m_spatialIndex.insert(item);
+		indexWords(parent->page(), item, true);
 	} else if (HOCRPage* page = dynamic_cast<HOCRPage*> (item)) {
 		page->m_index = i;
 		m_pages.insert(i++, page);
+		m_wordIndex.addPage(page);
 		for (int n = m_pages.size(); i < n; ++i) {
 			m_pages[i]->m_index = i;
 		}
-		emit dataChanged(index(page->index(), 0), index(m_pages.size() - 1, 0), {Qt::DisplayRole});
+		m_pageNumberingTimer.start();
 	}
 }
 
@@ -755,14 +1255,17 @@ void HOCRDocument::deleteItem(HOCRItem* item) {
 
 void HOCRDocument::takeItem(HOCRItem* item) {
 	if (item->parent()) {
+		item->page()->m_spatialIndex.remove(item);
+		indexWords(item->page(), item, false);
 		item->parent()->takeChild(item);
 	} else if (const HOCRPage* page = dynamic_cast<HOCRPage*> (item)) {
+		m_wordIndex.removePage(page);
 		int i = page->index();
 		m_pages.remove(i);
 		for (int n = m_pages.size(); i < n; ++i) {
 			m_pages[i]->m_index = i;
 		}
-		emit dataChanged(index(page->index(), 0), index(m_pages.size() - 1, 0), {Qt::DisplayRole});
+		m_pageNumberingTimer.start();
 	}
 }
 
@@ -770,45 +1273,422 @@ void HOCRDocument::takeItem(HOCRItem* item) {
 
 QMap<QString, QString> HOCRItem::s_langCache = QMap<QString, QString>();
 
-QMap<QString, QString> HOCRItem::deserializeAttrGroup(const QString& string) {
-	QMap<QString, QString> attrs;
-	for (const QString& attr : string.split(QRegularExpression("\\s*;\\s*"))) {
-		int splitPos = attr.indexOf(QRegularExpression("\\s+"));
-		QString key = attr.left(splitPos);
-		QString value = splitPos > 0 ? attr.mid(splitPos + 1) : "";
+static const QString s_itemClassNames[] = {"", "ocr_page", "ocr_carea", "ocr_par", "ocr_line", "ocrx_word", "ocr_graphic", "ocr_photo", "ocr_separator"};
+
+// Key names are only ever appended, in chunks which never move, so that they can be read without locking
+static constexpr int s_attrKeyChunkSize = 256;
+static QAtomicPointer<QString> s_attrKeyNames[(std::numeric_limits<quint16>::max() + 1) / s_attrKeyChunkSize];
+static int s_attrKeyCount = 0;
+static QHash<QString, int> initialAttrKeyIds() {
+	static const QString knownNames[] = {"baseline", "bbox", "class", "id", "image", "lang", "pageno", "ppageno", "rot", "scan_res", "x_ascenders", "x_descenders", "x_font", "x_fsize", "x_size", "x_wconf"};
+	QHash<QString, int> ids;
+	s_attrKeyNames[0].storeRelease(new QString[s_attrKeyChunkSize]);
+	for (const QString& name : knownNames) {
+		s_attrKeyNames[0].loadRelaxed()[s_attrKeyCount] = name;
+		ids.insert(name, s_attrKeyCount++);
+	}
+	return ids;
+}
+static QHash<QString, int> s_attrKeyIds = initialAttrKeyIds();
+static QReadWriteLock s_attrKeyLock;
+static QSet<QString> s_attrValuePool;
+static QMutex s_attrValuePoolMutex;
+
+HOCRItem::AttrKey HOCRItem::internKey(const QString& name) {
+	int key = lookupKey(name);
+	if (key >= 0) {
+		return key;
+	}
+	QWriteLocker locker(&s_attrKeyLock);
+	key = s_attrKeyIds.value(name, -1);
+	if (key < 0) {
+		// All keys are taken (which only a malicious file would do), further names share the last key
+		if (s_attrKeyCount > std::numeric_limits<AttrKey>::max()) {
+			return std::numeric_limits<AttrKey>::max();
+		}
+		key = s_attrKeyCount;
+		QAtomicPointer<QString>& chunk = s_attrKeyNames[key / s_attrKeyChunkSize];
+		if (!chunk.loadRelaxed()) {
+			chunk.storeRelease(new QString[s_attrKeyChunkSize]);
+		}
+		chunk.loadRelaxed()[key % s_attrKeyChunkSize] = name;
+		// Published by the lock, a key is only handed out once its name is stored
+		++s_attrKeyCount;
+		s_attrKeyIds.insert(name, key);
+	}
+	return key;
+}
+
+int HOCRItem::lookupKey(const QString& name) {
+	QReadLocker locker(&s_attrKeyLock);
+	return s_attrKeyIds.value(name, -1);
+}
+
+const QString& HOCRItem::keyName(AttrKey key) {
+	return s_attrKeyNames[key / s_attrKeyChunkSize].loadAcquire()[key % s_attrKeyChunkSize];
+}
+
+QString HOCRItem::internValue(const QString& value) {
+	// Share the string data of values which repeat a lot (i.e. font names and languages)
+	QMutexLocker locker(&s_attrValuePoolMutex);
+	auto it = s_attrValuePool.find(value);
+	if (it == s_attrValuePool.end()) {
+		it = s_attrValuePool.insert(value);
+	}
+	return *it;
+}
+
+// A value is only stored typed if formatting the typed value yields the very same string
+static bool parseCanonicalInt(const QString& string, int& value) {
+	bool ok = false;
+	value = string.toInt(&ok);
+	return ok && QString::number(value) == string;
+}
+
+static bool parseCanonicalFloat(const QString& string, float& value) {
+	for (QChar c : string) {
+		if (!c.isDigit() && c != '.' && c != '-') {
+			return false;
+		}
+	}
+	bool ok = false;
+	value = string.toFloat(&ok);
+	return ok && QString::number(value) == string;
+}
+
+// Parses [begin, end) of the string like QString::toInt, and checks whether it is what QString::number yields
+static int parseInt(const QString& string, int begin, int end, bool& canonical) {
+	const QChar* data = string.constData();
+	int pos = begin;
+	bool negative = pos < end && data[pos] == '-';
+	if (negative) {
+		++pos;
+	}
+	int nDigits = end - pos;
+	if (nDigits > 0 && nDigits <= 9) {
+		int value = 0;
+		for (; pos < end && data[pos] >= '0' && data[pos] <= '9'; ++pos) {
+			value = 10 * value + (data[pos].unicode() - '0');
+		}
+		if (pos == end) {
+			canonical = canonical && (data[end - nDigits] != '0' || (nDigits == 1 && !negative));
+			return negative ? -value : value;
+		}
+	}
+	QString token = string.mid(begin, end - begin);
+	bool ok = false;
+	int value = token.toInt(&ok);
+	canonical = canonical && ok && QString::number(value) == token;
+	return value;
+}
+
+// Same result as splitting at runs of whitespace and converting the four parts with QString::toInt
+static bool parseBBox(const QString& string, int coords[4], bool& canonical) {
+	const QChar* data = string.constData();
+	int n = string.length();
+	int pos = 0;
+	int count = 0;
+	canonical = true;
+	while (true) {
+		int end = pos;
+		while (end < n && !data[end].isSpace()) {
+			++end;
+		}
+		if (count == 4) {
+			return false;
+		}
+		coords[count++] = parseInt(string, pos, end, canonical);
+		if (end == n) {
+			break;
+		}
+		pos = end;
+		while (pos < n && data[pos].isSpace()) {
+			++pos;
+		}
+		canonical = canonical && pos == end + 1 && data[end] == ' ';
+	}
+	return count == 4;
+}
+
+static void appendInt(QString& string, int value) {
+	char buf[12];
+	char* end = buf + sizeof(buf);
+	char* pos = end;
+	unsigned int abs = value < 0 ? 0u - unsigned(value) : unsigned(value);
+	do {
+		*--pos = char('0' + abs % 10);
+		abs /= 10;
+	} while (abs);
+	if (value < 0) {
+		*--pos = '-';
+	}
+	string.append(QLatin1String(pos, int (end - pos)));
+}
+
+// Splits a title attribute "key value; key value" into its properties, in order of appearance. Same result
+// as splitting at semicolons including their surrounding whitespace, and each property at its first whitespace.
+static void tokenizeTitleAttrs(const QString& string, QVector<QPair<QString, QString>>& attrs) {
+	const QChar* data = string.constData();
+	int n = string.length();
+	int pos = 0;
+	while (true) {
+		int sep = pos;
+		while (sep < n && data[sep] != ';') {
+			++sep;
+		}
+		int end = sep;
+		if (sep < n) {
+			while (end > pos && data[end - 1].isSpace()) {
+				--end;
+			}
+		}
+		int split = pos;
+		while (split < end && !data[split].isSpace()) {
+			++split;
+		}
+		QString key = string.mid(pos, split - pos);
+		QString value = split > pos && split < end ? string.mid(split + 1, end - split - 1) : QString("");
 		if (key == "x_font" && value.length() >= 2 && value.startsWith('\'') && value.endsWith('\'')) {
 			value = value.mid(1, value.length() - 2);
 		}
-		attrs.insert(key, value);
+		attrs.append(qMakePair(key, value));
+		if (sep == n) {
+			break;
+		}
+		pos = sep + 1;
+		while (pos < n && data[pos].isSpace()) {
+			++pos;
+		}
+	}
+}
+
+const HOCRItem::AttrEntry* HOCRItem::findAttr(AttrGroup group, AttrKey key) const {
+	const QVector<AttrEntry>& attrs = group == TitleAttrs ? m_titleAttrs : m_attrs;
+	auto it = std::lower_bound(attrs.begin(), attrs.end(), key, attrKeyLess);
+	return it != attrs.end() && it->key == key ? &*it : nullptr;
+}
+
+QString HOCRItem::attrValue(AttrGroup group, AttrKey key, const QString& defaultValue) const {
+	const AttrEntry* attr = findAttr(group, key);
+	if (!attr) {
+		return defaultValue;
+	}
+	return attr->typed ? typedValue(key) : attr->value;
+}
+
+void HOCRItem::setAttr(AttrGroup group, AttrKey key, const QString& value) {
+	QVector<AttrEntry>& attrs = group == TitleAttrs ? m_titleAttrs : m_attrs;
+	int pos = std::lower_bound(attrs.cbegin(), attrs.cend(), key, attrKeyLess) - attrs.cbegin();
+	if (pos == attrs.size() || attrs[pos].key != key) {
+		attrs.insert(pos, AttrEntry{key, false, QString()});
+	}
+	AttrEntry& attr = attrs[pos];
+	bool typed = group == HtmlAttrs ? key == KeyClass : (key == KeyBBox || key == KeyBaseline || key == KeyFontSize || key == KeySize || key == KeyWConf);
+	attr.typed = typed && setTypedValue(key, value);
+	if (group == TitleAttrs && key == KeyBBox && m_pageItem && m_pageItem != this) {
+		m_pageItem->m_spatialIndex.update(this);
+	}
+	if (attr.typed) {
+		attr.value = QString();
+	} else if (key == KeyFont || key == KeyLang) {
+		attr.value = internValue(value);
+	} else {
+		attr.value = value;
+	}
+}
+
+void HOCRItem::removeAttr(AttrGroup group, AttrKey key) {
+	QVector<AttrEntry>& attrs = group == TitleAttrs ? m_titleAttrs : m_attrs;
+	int pos = std::lower_bound(attrs.cbegin(), attrs.cend(), key, attrKeyLess) - attrs.cbegin();
+	if (pos < attrs.size() && attrs[pos].key == key) {
+		attrs.remove(pos);
+	}
+	if (group == HtmlAttrs && key == KeyClass) {
+		m_itemClass = ItemClass::Other;
+	}
+}
+
+QMap<QString, QString> HOCRItem::attrMap(AttrGroup group) const {
+	QMap<QString, QString> map;
+	for (const AttrEntry& attr : group == TitleAttrs ? m_titleAttrs : m_attrs) {
+		map.insert(keyName(attr.key), attr.typed ? typedValue(attr.key) : attr.value);
+	}
+	return map;
+}
+
+QString HOCRItem::typedValue(AttrKey key) const {
+	QString value;
+	appendTypedValue(value, key);
+	return value;
+}
+
+void HOCRItem::appendTypedValue(QString& string, AttrKey key) const {
+	switch (key) {
+	case KeyClass:
+		string += s_itemClassNames[int (m_itemClass)];
+		break;
+	case KeyBBox:
+		appendInt(string, m_bbox.left());
+		string += ' ';
+		appendInt(string, m_bbox.top());
+		string += ' ';
+		appendInt(string, m_bbox.right());
+		string += ' ';
+		appendInt(string, m_bbox.bottom());
+		break;
+	case KeyBaseline:
+		string += QString::number(m_baseline[0]);
+		string += ' ';
+		string += QString::number(m_baseline[1]);
+		break;
+	case KeyFontSize:
+		string += QString::number(m_fontSize);
+		break;
+	case KeySize:
+		string += QString::number(m_size);
+		break;
+	case KeyWConf:
+		appendInt(string, m_wconf);
+		break;
+	default:
+		break;
+	}
+}
+
+bool HOCRItem::setTypedValue(AttrKey key, const QString& value) {
+	switch (key) {
+	case KeyClass: {
+		m_itemClass = ItemClass::Other;
+		for (int i = 1, n = sizeof(s_itemClassNames) / sizeof(s_itemClassNames[0]); i < n; ++i) {
+			if (value == s_itemClassNames[i]) {
+				m_itemClass = static_cast<ItemClass>(i);
+			}
+		}
+		return m_itemClass != ItemClass::Other;
+	}
+	case KeyBBox: {
+		// The bbox is parsed as lenient as before, but only stored typed if the string is in canonical form
+		int coords[4];
+		bool canonical = false;
+		if (!parseBBox(value, coords, canonical)) {
+			return false;
+		}
+		m_bbox.setCoords(coords[0], coords[1], coords[2], coords[3]);
+		return canonical;
+	}
+	case KeyBaseline: {
+		QStringList parts = value.split(' ');
+		return parts.size() == 2 && parseCanonicalFloat(parts[0], m_baseline[0]) && parseCanonicalFloat(parts[1], m_baseline[1]);
+	}
+	case KeyFontSize:
+		return parseCanonicalFloat(value, m_fontSize);
+	case KeySize:
+		return parseCanonicalFloat(value, m_size);
+	case KeyWConf:
+		return parseCanonicalInt(value, m_wconf);
+	default:
+		return false;
+	}
+}
+
+void HOCRItem::attrWriteOrder(const QVector<AttrEntry>& attrs, QVarLengthArray<int, 16>& order) {
+	order.resize(attrs.size());
+	std::iota(order.begin(), order.end(), 0);
+	// Entries are sorted by key id, which only follows the names for the predefined keys,
+	// other keys are numbered in the order they were first seen
+	if (!attrs.isEmpty() && attrs.last().key > KeyWConf) {
+		std::sort(order.begin(), order.end(), [&attrs](int a, int b) {
+			return keyName(attrs[a].key) < keyName(attrs[b].key);
+		});
+	}
+}
+
+void HOCRItem::writeTitleAttrs(QString& string) const {
+	QVarLengthArray<int, 16> order;
+	attrWriteOrder(m_titleAttrs, order);
+	for (int i = 0, n = order.size(); i < n; ++i) {
+		const AttrEntry& attr = m_titleAttrs[order[i]];
+		if (i > 0) {
+			string += "; ";
+		}
+		string += keyName(attr.key);
+		string += ' ';
+		if (attr.typed) {
+			appendTypedValue(string, attr.key);
+		} else if (attr.key == KeyFont && !attr.value.isEmpty()) {
+			string += '\'';
+			string += attr.value;
+			string += '\'';
+		} else {
+			string += attr.value;
+		}
+	}
+}
+
+QString HOCRItem::itemClass() const {
+	return m_itemClass == ItemClass::Other ? attrValue(HtmlAttrs, KeyClass) : s_itemClassNames[int (m_itemClass)];
+}
+
+double HOCRItem::fontSize() const {
+	const AttrEntry* attr = findAttr(TitleAttrs, KeyFontSize);
+	return !attr ? 0. : attr->typed ? m_fontSize : attr->value.toDouble();
+}
+
+int HOCRItem::wordConfidence() const {
+	const AttrEntry* attr = findAttr(TitleAttrs, KeyWConf);
+	return !attr ? 0 : attr->typed ? m_wconf : attr->value.toInt();
+}
+
+QMap<QString, QString> HOCRItem::deserializeAttrGroup(const QString& string) {
+	QVector<QPair<QString, QString>> tokens;
+	tokenizeTitleAttrs(string, tokens);
+	QMap<QString, QString> attrs;
+	for (const QPair<QString, QString>& token : tokens) {
+		attrs.insert(token.first, token.second);
 	}
 	return attrs;
 }
 
 QString HOCRItem::serializeAttrGroup(const QMap<QString, QString>& attrs) {
-	QStringList list;
+	QString string;
 	for (auto it = attrs.begin(), itEnd = attrs.end(); it != itEnd; ++it) {
-		QString value = it.value();
-		if (it.key() == "x_font" && !value.isEmpty()) {
-			value = QString("'%1'").arg(value);
+		if (it != attrs.begin()) {
+			string += "; ";
+		}
+		string += it.key();
+		string += ' ';
+		if (it.key() == "x_font" && !it.value().isEmpty()) {
+			string += '\'';
+			string += it.value();
+			string += '\'';
+		} else {
+			string += it.value();
 		}
-		list.append(QString("%1 %2").arg(it.key(), value));
 	}
-	return list.join("; ");
+	return string;
+}
+
+void HOCRItem::setMisspelled(int misspelled) {
+	if (m_itemClass == ItemClass::Word && m_pageItem && m_pageItem->m_wordStatsValid) {
+		m_pageItem->m_misspelledWords += (misspelled == 1) - (m_misspelled == 1);
+		m_pageItem->m_uncheckedWords += (misspelled == -1) - (m_misspelled == -1);
+	}
+	m_misspelled = misspelled;
 }
 
 QString HOCRItem::trimmedWord(const QString& word, QString* prefix, QString* suffix) {
 	QString noaccentWord = Utils::removeDiacritics(word);
 	// correctly trim words with apostrophes or hyphens within them, phrases with dashes, initialisms/acronyms, and numeric citations
-	QRegularExpression wordRe("^(\\W*)(\\w?|\\w(\\w|[-\u2013\u2014'’])*\\w|(\\w+\\.){2,})([\\W\u00b2\u00b3\u00b9\u2070\\-\u207e]*)$");
-	QRegularExpressionMatch match;
-	if ((match = wordRe.match(noaccentWord)).hasMatch()) {
+	static const QRegularExpression wordRe("^(\\W*)(\\w?|\\w(\\w|[-\u2013\u2014'’])*\\w|(\\w+\\.){2,})([\\W\u00b2\u00b3\u00b9\u2070\\-\u207e]*)$");
+	QRegularExpressionMatch match = wordRe.match(noaccentWord);
+	if (match.hasMatch()) {
 		if (prefix) {
 			*prefix = match.captured(1);
 		}
 		if (suffix) {
 			*suffix = match.captured(5);
 		}
-		return word.mid(match.captured(1).length(), word.length() - match.captured(1).length() - match.captured(5).length());
+		return word.mid(match.capturedLength(1), word.length() - match.capturedLength(1) - match.capturedLength(5));
 	}
 	return word;
 }
@@ -820,43 +1700,56 @@ HOCRItem::HOCRItem(const QDomElement& element, HOCRPage* page, HOCRItem* parent,
 	for (int i = 0, n = attributes.size(); i < n; ++i) {
 		QString attrName = attributes.item(i).nodeName();
 		if (attrName == "title") {
-			m_titleAttrs = deserializeAttrGroup(attributes.item(i).nodeValue());
+			QVector<QPair<QString, QString>> titleAttrs;
+			tokenizeTitleAttrs(attributes.item(i).nodeValue(), titleAttrs);
+			for (int j = 0, m = titleAttrs.size(); j < m; ++j) {
+				// If a property is repeated, the last occurrence applies
+				AttrKey key = internKey(titleAttrs[j].first);
+				bool repeated = false;
+				for (int k = j + 1; k < m && !repeated; ++k) {
+					repeated = titleAttrs[k].first == titleAttrs[j].first;
+				}
+				if (!repeated) {
+					setAttr(TitleAttrs, key, titleAttrs[j].second);
+				}
+			}
 		} else {
-			m_attrs[attrName] = attributes.item(i).nodeValue();
+			setAttr(HtmlAttrs, internKey(attrName), attributes.item(i).nodeValue());
 		}
 	}
 	// Map ocr_header/ocr_caption/ocr_textfloat to ocr_line
-	if (m_attrs["class"] == "ocr_header" || m_attrs["class"] == "ocr_caption" || m_attrs["class"] == "ocr_textfloat") {
-		m_attrs["class"] = "ocr_line";
+	QString cls = attrValue(HtmlAttrs, KeyClass);
+	if (!hasAttr(HtmlAttrs, KeyClass)) {
+		setAttr(HtmlAttrs, KeyClass, QString());
+	} else if (cls == "ocr_header" || cls == "ocr_caption" || cls == "ocr_textfloat") {
+		setAttr(HtmlAttrs, KeyClass, "ocr_line");
 	}
-	// Adjust item id based on pageId
 	if (parent) {
-		QString idClass = itemClass().mid(itemClass().indexOf("_") + 1);
-		int counter = page->m_idCounters.value(idClass, 0) + 1;
-		page->m_idCounters[idClass] = counter;
-		QString newId = QString("%1_%2_%3").arg(idClass).arg(page->pageId()).arg(counter);
-		m_attrs["id"] = newId;
+		assignId();
 	}
 
-	// Parse item bbox
-	QStringList bbox = m_titleAttrs["bbox"].split(QRegularExpression("\\s+"));
-	if (bbox.size() == 4) {
-		m_bbox.setCoords(bbox[0].toInt(), bbox[1].toInt(), bbox[2].toInt(), bbox[3].toInt());
+	// The item bbox is parsed when setting the attribute, the attribute is always present
+	if (!hasAttr(TitleAttrs, KeyBBox)) {
+		setAttr(TitleAttrs, KeyBBox, QString());
 	}
 
-	if (itemClass() == "ocrx_word") {
+	if (m_itemClass == ItemClass::Word) {
 		m_text = element.text();
 		m_bold = !element.elementsByTagName("strong").isEmpty();
 		m_italic = !element.elementsByTagName("em").isEmpty();
-	} else if (itemClass() == "ocr_line") {
+	} else if (m_itemClass == ItemClass::Line) {
 		// Depending on the locale, tesseract can use a comma instead of a dot as decimal separator in the baseline...
-		m_titleAttrs["baseline"] = m_titleAttrs["baseline"].replace(",", ".");
+		setAttr(TitleAttrs, KeyBaseline, attrValue(TitleAttrs, KeyBaseline).replace(",", "."));
 		m_misspelled = false;
 	} else {
 		m_misspelled = false;
 	}
 }
 
+HOCRItem::HOCRItem(HOCRPage* page, HOCRItem* parent, int index)
+	: m_bold(false), m_italic(false), m_pageItem(page), m_parentItem(parent), m_index(index) {
+}
+
 HOCRItem::~HOCRItem() {
 	qDeleteAll(m_childItems);
 }
@@ -864,20 +1757,30 @@ HOCRItem::~HOCRItem() {
 void HOCRItem::addChild(HOCRItem* child) {
 	m_childItems.append(child);
 	child->m_parentItem = this;
-	child->m_pageItem = m_pageItem;
+	child->setPage(m_pageItem);
 	child->m_index = m_childItems.size() - 1;
 }
 
 void HOCRItem::insertChild(HOCRItem* child, int i) {
 	m_childItems.insert(i, child);
 	child->m_parentItem = this;
-	child->m_pageItem = m_pageItem;
+	child->setPage(m_pageItem);
 	child->m_index = i++;
 	for (int n = m_childItems.size(); i < n; ++i) {
 		m_childItems[i]->m_index = i;
 	}
 }
 
+void HOCRItem::setPage(HOCRPage* page) {
+	// Items moved to another page take their descendants along
+	if (m_pageItem != page) {
+		m_pageItem = page;
+		for (HOCRItem* child : m_childItems) {
+			child->setPage(page);
+		}
+	}
+}
+
 void HOCRItem::removeChild(HOCRItem* child) {
 	takeChild(child);
 	delete child;
@@ -901,14 +1804,11 @@ QVector<HOCRItem*> HOCRItem::takeChildren() {
 }
 
 QMap<QString, QString> HOCRItem::getAllAttributes() const {
-	QMap<QString, QString> attrValues;
-	for (auto it = m_attrs.begin(), itEnd = m_attrs.end(); it != itEnd; ++it) {
-		attrValues.insert(it.key(), it.value());
+	QMap<QString, QString> attrValues = attrMap(HtmlAttrs);
+	for (const AttrEntry& attr : m_titleAttrs) {
+		attrValues.insert(QString("title:%1").arg(keyName(attr.key)), attr.typed ? typedValue(attr.key) : attr.value);
 	}
-	for (auto it = m_titleAttrs.begin(), itEnd = m_titleAttrs.end(); it != itEnd; ++it) {
-		attrValues.insert(QString("title:%1").arg(it.key()), it.value());
-	}
-	if (itemClass() == "ocrx_word") {
+	if (m_itemClass == ItemClass::Word) {
 		if (!attrValues.contains("title:x_font")) {
 			attrValues.insert("title:x_font", "");
 		}
@@ -924,13 +1824,15 @@ QMap<QString, QString> HOCRItem::getAttributes(const QList<QString>& names = QLi
 		QStringList parts = attrName.split(":");
 		if (parts.size() > 1) {
 			Q_ASSERT(parts[0] == "title");
-			attrValues.insert(attrName, m_titleAttrs.value(parts[1]));
+			int key = lookupKey(parts[1]);
+			attrValues.insert(attrName, key >= 0 ? attrValue(TitleAttrs, key) : QString());
 		} else if (attrName == "bold") {
 			attrValues.insert(attrName, fontBold() ? "1" : "0");
 		} else if (attrName == "italic") {
 			attrValues.insert(attrName, fontItalic() ? "1" : "0");
 		} else {
-			attrValues.insert(attrName, m_attrs[attrName]);
+			int key = lookupKey(attrName);
+			attrValues.insert(attrName, key >= 0 ? attrValue(HtmlAttrs, key) : QString());
 		}
 	}
 	return attrValues;
@@ -943,10 +1845,11 @@ void HOCRItem::getPropagatableAttributes(QMap<QString, QMap<QString, QSet<QStrin
 		{"ocrx_word", {"lang", "title:x_fsize", "title:x_font", "bold", "italic"}}
 	};
 
-	QString childClass = m_childItems.isEmpty() ? "" : m_childItems.front()->itemClass();
+	const QVector<HOCRItem*>& childItems = children();
+	QString childClass = childItems.isEmpty() ? "" : childItems.front()->itemClass();
 	auto it = s_propagatableAttributes.find(childClass);
 	if (it != s_propagatableAttributes.end()) {
-		for (const HOCRItem* child : m_childItems) {
+		for (const HOCRItem* child : childItems) {
 			QMap<QString, QString> attrs = child->getAttributes(it.value());
 			for (auto attrIt = attrs.begin(), attrItEnd = attrs.end(); attrIt != attrItEnd; ++attrIt) {
 				occurrences[childClass][attrIt.key()].insert(attrIt.value());
@@ -954,7 +1857,7 @@ void HOCRItem::getPropagatableAttributes(QMap<QString, QMap<QString, QSet<QStrin
 		}
 	}
 	if (childClass != "ocrx_word") {
-		for (const HOCRItem* child : m_childItems) {
+		for (const HOCRItem* child : childItems) {
 			child->getPropagatableAttributes(occurrences);
 		}
 	}
@@ -962,7 +1865,7 @@ void HOCRItem::getPropagatableAttributes(QMap<QString, QMap<QString, QSet<QStrin
 
 void HOCRItem::setAttribute(const QString& name, const QString& value, const QString& attrItemClass) {
 	if (!attrItemClass.isEmpty() && itemClass() != attrItemClass) {
-		for (HOCRItem* child : m_childItems) {
+		for (HOCRItem* child : children()) {
 			child->setAttribute(name, value, attrItemClass);
 		}
 		return;
@@ -973,35 +1876,38 @@ void HOCRItem::setAttribute(const QString& name, const QString& value, const QSt
 	} else if (name == "italic") {
 		m_italic = value == "1";
 	} else if (parts.size() < 2) {
-		m_attrs[name] = value;
+		setAttr(HtmlAttrs, internKey(name), value);
 	} else {
 		Q_ASSERT(parts[0] == "title");
-		m_titleAttrs[parts[1]] = value;
-		if (name == "title:bbox") {
-			QStringList bbox = value.split(QRegularExpression("\\s+"));
-			Q_ASSERT(bbox.size() == 4);
-			m_bbox.setCoords(bbox[0].toInt(), bbox[1].toInt(), bbox[2].toInt(), bbox[3].toInt());
-		}
+		// Also updates the typed values, i.e. the bbox
+		setAttr(TitleAttrs, internKey(parts[1]), value);
 	}
 }
 
 QString HOCRItem::toHtml(int indent) const {
-	QString cls = itemClass();
-	QString tag;
-	if (cls == "ocr_page" || cls == "ocr_carea" || cls == "ocr_graphic" || cls == "ocr_photo" || cls == "ocr_separator") {
-		tag = "div";
-	} else if (cls == "ocr_par") {
-		tag = "p";
-	} else {
-		tag = "span";
-	}
-	QString html = QString(indent, ' ') + "<" + tag;
-	html += QString(" title=\"%1\"").arg(serializeAttrGroup(m_titleAttrs));
-	for (auto it = m_attrs.begin(), itEnd = m_attrs.end(); it != itEnd; ++it) {
-		html += QString(" %1=\"%2\"").arg(it.key(), it.value());
+	QString html;
+	writeHtml(html, indent);
+	return html;
+}
+
+static const char* htmlTag(HOCRItem::ItemClass itemClass) {
+	switch (itemClass) {
+	case HOCRItem::ItemClass::Page:
+	case HOCRItem::ItemClass::CArea:
+	case HOCRItem::ItemClass::Graphic:
+	case HOCRItem::ItemClass::Photo:
+	case HOCRItem::ItemClass::Separator:
+		return "div";
+	case HOCRItem::ItemClass::Par:
+		return "p";
+	default:
+		return "span";
 	}
-	html += ">";
-	if (cls == "ocrx_word") {
+}
+
+void HOCRItem::writeHtml(QString& html, int indent) const {
+	writeHtmlStartTag(html, indent);
+	if (m_itemClass == ItemClass::Word) {
 		if (m_bold) {
 			html += "<strong>";
 		}
@@ -1015,40 +1921,85 @@ QString HOCRItem::toHtml(int indent) const {
 		if (m_bold) {
 			html += "</strong>";
 		}
+		html += "</";
+		html += htmlTag(m_itemClass);
+		html += ">\n";
 	} else {
 		html += "\n";
-		for (const HOCRItem* child : m_childItems) {
-			html += child->toHtml(indent + 1);
+		for (const HOCRItem* child : children()) {
+			child->writeHtml(html, indent + 1);
 		}
-		html += QString(indent, ' ');
+		writeHtmlEndTag(html, indent);
 	}
-	html += "</" + tag + ">\n";
-	return html;
+}
+
+void HOCRItem::writeHtmlStartTag(QString& html, int indent) const {
+	html += QString(indent, ' ');
+	html += '<';
+	html += htmlTag(m_itemClass);
+	html += " title=\"";
+	writeTitleAttrs(html);
+	html += '"';
+	QVarLengthArray<int, 16> order;
+	attrWriteOrder(m_attrs, order);
+	for (int index : order) {
+		const AttrEntry& attr = m_attrs[index];
+		html += ' ';
+		html += keyName(attr.key);
+		html += "=\"";
+		html += attr.typed ? typedValue(attr.key) : attr.value;
+		html += '"';
+	}
+	html += '>';
+}
+
+void HOCRItem::writeHtmlEndTag(QString& html, int indent) const {
+	html += QString(indent, ' ');
+	html += "</";
+	html += htmlTag(m_itemClass);
+	html += ">\n";
 }
 
 QPair<double, double> HOCRItem::baseLine() const {
 	static const QRegularExpression baseLineRx = QRegularExpression("([+-]?\\d+\\.?\\d*)\\s+([+-]?\\d+\\.?\\d*)");
+	const AttrEntry* attr = findAttr(TitleAttrs, KeyBaseline);
+	if (attr && attr->typed) {
+		return qMakePair(double (m_baseline[0]), double (m_baseline[1]));
+	}
 	QRegularExpressionMatch match;
-	if ((match = baseLineRx.match(m_titleAttrs["baseline"])).hasMatch()) {
+	if ((match = baseLineRx.match(attr ? attr->value : QString())).hasMatch()) {
 		return qMakePair(match.captured(1).toDouble(), match.captured(2).toDouble());
 	}
 	return qMakePair(0.0, 0.0);
 }
 
+void HOCRItem::assignId() {
+	// Adjust item id based on pageId
+	QString idClass = itemClass().mid(itemClass().indexOf("_") + 1);
+	int counter = m_pageItem->m_idCounters.value(idClass, 0) + 1;
+	m_pageItem->m_idCounters[idClass] = counter;
+	QString newId = QString("%1_%2_%3").arg(idClass).arg(m_pageItem->pageId()).arg(counter);
+	setAttr(HtmlAttrs, KeyId, newId);
+}
+
+QString HOCRItem::inheritedLanguage(const QString& elemLang, const QString& defaultLanguage) {
+	auto it = s_langCache.find(elemLang);
+	if (it == s_langCache.end()) {
+		it = s_langCache.insert(elemLang, Utils::getSpellingLanguage(elemLang, defaultLanguage));
+	}
+	return it.value();
+}
+
 bool HOCRItem::parseChildren(const QDomElement& element, QString language, const QString& defaultLanguage) {
 	// Determine item language (inherit from parent if not specified)
 	QString elemLang = element.attribute("lang");
 	if (!elemLang.isEmpty()) {
-		auto it = s_langCache.find(elemLang);
-		if (it == s_langCache.end()) {
-			it = s_langCache.insert(elemLang, Utils::getSpellingLanguage(elemLang, defaultLanguage));
-		}
-		m_attrs.remove("lang");
-		language = it.value();
+		removeAttr(HtmlAttrs, KeyLang);
+		language = inheritedLanguage(elemLang, defaultLanguage);
 	}
 
-	if (itemClass() == "ocrx_word") {
-		m_attrs["lang"] = language;
+	if (m_itemClass == ItemClass::Word) {
+		setAttr(HtmlAttrs, KeyLang, language);
 		return !m_text.isEmpty();
 	}
 	bool haveWords = false;
@@ -1063,27 +2014,132 @@ bool HOCRItem::parseChildren(const QDomElement& element, QString language, const
 
 ///////////////////////////////////////////////////////////////////////////////
 
+static QAtomicInt s_pageAccessTick;
+static QMutex s_pageLoadMutex;
+
 HOCRPage::HOCRPage(const QDomElement& element, int pageId, const QString& defaultLanguage, bool cleanGraphics, int index)
 	: HOCRItem(element, this, nullptr, index), m_pageId(pageId) {
-	m_attrs["id"] = QString("page_%1").arg(pageId);
+	initPage();
+	parsePage(element, defaultLanguage, cleanGraphics);
+	countWords(this);
+}
+
+HOCRPage::HOCRPage(const QDomElement& element, const QByteArray& pageXml, int childCount, const HOCRPageWords& words, int pageId, const QString& defaultLanguage, int index)
+	: HOCRItem(element, this, nullptr, index), m_pageId(pageId), m_pageXml(qCompress(pageXml)), m_defaultLanguage(defaultLanguage), m_childCount(childCount), m_loaded(0) {
+	initPage();
+	m_lastAccess = s_pageAccessTick.loadRelaxed();
+	m_lowConfidenceWords = words.lowConfidence;
+	// Pages may be read from worker threads, so the languages are only resolved once the words are used
+	QHash<QString, QSet<QString>> spellingWords;
+	for (int i = 0, n = words.texts.size(); i < n; ++i) {
+		const QString& word = words.texts[i];
+		QString normalized = HOCRWordIndex::normalize(word);
+		if (!normalized.isEmpty()) {
+			++m_wordCounts[normalized];
+		}
+		QString trimmed = trimmedWord(word);
+		if (!trimmed.isEmpty()) {
+			spellingWords[words.langs[i]].insert(trimmed);
+		}
+	}
+	for (auto it = spellingWords.begin(), itEnd = spellingWords.end(); it != itEnd; ++it) {
+		m_spellingWords.insert(it.key(), it.value().values());
+	}
+	m_spellingWordsKey = SpellingWords::ByLangAttribute;
+}
 
-	m_sourceFile = m_titleAttrs["image"].replace(QRegularExpression("^['\"]"), "").replace(QRegularExpression("['\"]$"), "");
+HOCRPage::HOCRPage(const QSharedPointer<HOCRProject>& project, int projectPage, int pageId, const QString& defaultLanguage, int index)
+	: HOCRItem(this, nullptr, index), m_pageId(pageId), m_project(project), m_projectPage(projectPage), m_defaultLanguage(defaultLanguage), m_loaded(0) {
+	m_project->readPage(m_projectPage, this);
+	initPage();
+	m_lastAccess = s_pageAccessTick.loadRelaxed();
+}
+
+void HOCRPage::countWords(const HOCRItem* item) {
+	if (item->itemClassId() == ItemClass::Word) {
+		QString normalized = HOCRWordIndex::normalize(item->text());
+		if (!normalized.isEmpty()) {
+			++m_wordCounts[normalized];
+		}
+	}
+	for (const HOCRItem* child : item->m_childItems) {
+		countWords(child);
+	}
+}
+
+void HOCRPage::ensureWordStats() const {
+	if (!m_wordStatsValid) {
+		m_lowConfidenceWords = 0;
+		m_misspelledWords = 0;
+		m_uncheckedWords = 0;
+		countWordStats(this);
+		m_wordStatsValid = true;
+	}
+}
+
+void HOCRPage::countWordStats(const HOCRItem* item) const {
+	if (item->m_itemClass == ItemClass::Word) {
+		m_lowConfidenceWords += item->wordConfidence() < 90;
+		m_misspelledWords += item->m_misspelled == 1;
+		m_uncheckedWords += item->m_misspelled == -1;
+	}
+	for (const HOCRItem* child : item->children()) {
+		countWordStats(child);
+	}
+}
+
+const QHash<QString, QStringList>* HOCRPage::spellingWords() const {
+	if (m_spellingWordsKey == SpellingWords::Unknown) {
+		if (!m_project) {
+			return nullptr;
+		}
+		m_project->readPageWords(m_projectPage, m_spellingWords);
+	} else if (m_spellingWordsKey == SpellingWords::ByLangAttribute) {
+		// As when parsing the page, words without lang attribute are in the default language
+		QHash<QString, QStringList> spellingWords;
+		for (auto it = m_spellingWords.begin(), itEnd = m_spellingWords.end(); it != itEnd; ++it) {
+			spellingWords[it.key().isEmpty() ? m_defaultLanguage : inheritedLanguage(it.key(), m_defaultLanguage)].append(it.value());
+		}
+		m_spellingWords = spellingWords;
+	}
+	m_spellingWordsKey = SpellingWords::ByLanguage;
+	return &m_spellingWords;
+}
+
+void HOCRPage::initPage() {
+	setAttr(HtmlAttrs, KeyId, QString("page_%1").arg(m_pageId));
+
+	// Strip the quotes around the image path
+	m_sourceFile = attrValue(TitleAttrs, KeyImage);
+	if (m_sourceFile.startsWith('\'') || m_sourceFile.startsWith('"')) {
+		m_sourceFile.remove(0, 1);
+	}
+	if (m_sourceFile.endsWith('\'') || m_sourceFile.endsWith('"')) {
+		m_sourceFile.chop(1);
+	}
+	setAttr(TitleAttrs, KeyImage, m_sourceFile);
 	bool ok = false;
-	m_pageNr = m_titleAttrs["ppageno"].toInt(&ok);
+	m_pageNr = attrValue(TitleAttrs, KeyPPageNo).toInt(&ok);
 	// Code to handle pageno -> ppageno typo in previous versions of gImageReader
 	if (ok == false) {
-		m_pageNr = m_titleAttrs["pageno"].toInt();
-		m_titleAttrs["ppageno"] = m_titleAttrs["pageno"];
-		m_titleAttrs.remove("pageno");
+		QString pageNo = attrValue(TitleAttrs, KeyPageNo);
+		m_pageNr = pageNo.toInt();
+		setAttr(TitleAttrs, KeyPPageNo, pageNo);
+		removeAttr(TitleAttrs, KeyPageNo);
 	}
 	m_pageNr += 1;
 	// Hacky fix, at least for non-pdf sources, for older gImageReader versions which incorrectly stored one-based ppageno
 	if (!m_sourceFile.endsWith(".pdf", Qt::CaseInsensitive) && m_pageNr != 1) {
 		m_pageNr = 1;
 	}
-	m_angle = m_titleAttrs["rot"].toDouble();
-	m_resolution = m_titleAttrs.value("scan_res", "100").toInt();
+	if (!hasAttr(TitleAttrs, KeyRot)) {
+		setAttr(TitleAttrs, KeyRot, QString());
+	}
+	m_angle = attrValue(TitleAttrs, KeyRot).toDouble();
+	m_resolution = attrValue(TitleAttrs, KeyScanRes, "100").toInt();
+}
 
+void HOCRPage::parsePage(const QDomElement& element, const QString& defaultLanguage, bool cleanGraphics) {
 	QDomElement childElement = element.firstChildElement("div");
 	while (!childElement.isNull()) {
 		HOCRItem* item = new HOCRItem(childElement, this, this, m_childItems.size());
@@ -1110,11 +2166,84 @@ QString HOCRPage::title() const {
 	return QString("%1 [%2]").arg(QFileInfo(m_sourceFile).fileName()).arg(m_pageNr);
 }
 
+const HOCRSpatialIndex& HOCRPage::spatialIndex() const {
+	if (!m_spatialIndex.isBuilt()) {
+		m_spatialIndex.build(this);
+	}
+	return m_spatialIndex;
+}
+
+int HOCRPage::childCount() const {
+	return m_loaded.loadAcquire() ? m_childItems.size() : m_childCount;
+}
+
+void HOCRPage::ensureLoaded() const {
+	m_lastAccess = s_pageAccessTick.loadRelaxed();
+	if (!m_loaded.loadAcquire()) {
+		const_cast<HOCRPage*> (this)->load();
+	}
+}
+
+void HOCRPage::load() {
+	// Pages may also be accessed from worker threads, i.e. by exporters
+	QMutexLocker locker(&s_pageLoadMutex);
+	if (m_loaded.loadRelaxed()) {
+		return;
+	}
+	// Item ids are assigned in the same order as when the page was first read
+	m_idCounters.clear();
+	if (m_project) {
+		m_project->readPageItems(m_projectPage, this);
+	} else {
+		QDomDocument doc;
+		doc.setContent(qUncompress(m_pageXml));
+		parsePage(doc.documentElement(), m_defaultLanguage, false);
+	}
+	m_wordStatsValid = false;
+	m_loaded.storeRelease(1);
+}
+
+bool HOCRPage::unload() {
+	QMutexLocker locker(&s_pageLoadMutex);
+	if (!m_loaded.loadRelaxed() || (m_pageXml.isEmpty() && !m_project)) {
+		return false;
+	}
+	m_childCount = m_childItems.size();
+	m_loaded.storeRelease(0);
+	m_spatialIndex.clear();
+	qDeleteAll(m_childItems);
+	m_childItems.clear();
+	return true;
+}
+
+void HOCRPage::setModified() {
+	ensureLoaded();
+	m_pageXml = QByteArray();
+	m_project.reset();
+	m_spellingWords.clear();
+	m_spellingWordsKey = SpellingWords::Unknown;
+}
+
+void HOCRPage::setProject(const QSharedPointer<HOCRProject>& project, int projectPage) {
+	// The low confidence count needs to be current once the page can be unloaded again
+	if (m_loaded.loadAcquire()) {
+		ensureWordStats();
+	}
+	QMutexLocker locker(&s_pageLoadMutex);
+	m_pageXml = QByteArray();
+	m_project = project;
+	m_projectPage = projectPage;
+}
+
+int HOCRPage::advanceAccessTick() {
+	return s_pageAccessTick.fetchAndAddRelaxed(1) + 1;
+}
+
 void HOCRPage::convertSourcePath(const QString& basepath, bool absolute) {
 	if (absolute && !QFileInfo(m_sourceFile).isAbsolute()) {
 		m_sourceFile = QDir::cleanPath(QDir(basepath).absoluteFilePath(m_sourceFile));
 	} else if (!absolute && QFileInfo(m_sourceFile).isAbsolute() && m_sourceFile.startsWith(basepath)) {
 		m_sourceFile = QString("./%1").arg(QDir(basepath).relativeFilePath(m_sourceFile));
 	}
-	m_titleAttrs["image"] = QString("'%1'").arg(m_sourceFile);
+	setAttr(TitleAttrs, KeyImage, QString("'%1'").arg(m_sourceFile));
 }
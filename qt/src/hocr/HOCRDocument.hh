@@ -22,12 +22,27 @@
 
 #include "Config.hh"
 #include <QAbstractItemModel>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QPersistentModelIndex>
 #include <QRect>
+#include <QSet>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVarLengthArray>
+#include <functional>
+
+#include "HOCRSpatialIndex.hh"
+#include "HOCRWordIndex.hh"
 
 class QDomElement;
+class QIODevice;
 class HOCRItem;
 class HOCRPage;
-class HOCRSpellChecker;
+class HOCRProject;
+class HOCRSpellCheckerPool;
+struct HOCRPageWords;
 
 class HOCRDocument : public QAbstractItemModel {
 	Q_OBJECT
@@ -47,9 +62,31 @@ public:
 	void addSpellingActions(QMenu* menu, const QModelIndex& index);
 	void addWordToDictionary(const QModelIndex& index);
 
-	QString toHTML() const;
+	// Serializes the body of the document page by page
+	bool writeHTML(QIODevice* device) const;
+	// Appends the serialized page, without keeping it loaded if it was only loaded for serializing it
+	void writePageHtml(int i, QString& html) const;
+	// Appends the serialized items of the page, i.e. writePageHtml without the page element itself
+	void writePageChildrenHtml(int i, QString& html) const;
+	// Writes the document as binary project, see HOCRProject
+	bool writeProject(QIODevice* device) const;
+	// Releases the project file the pages are read from, so that it can be replaced
+	void releaseProject(const QString& filename);
+	// Reads the items of the pages from the project once they are unloaded, which holds them in the same order, see writeProject
+	void attachProject(const QSharedPointer<HOCRProject>& project);
 
 	QModelIndex insertPage(int beforeIdx, const QDomElement& pageElement, bool cleanGraphics, const QString& sourceBasePath = QString());
+	// Inserts a page whose items are only parsed from the serialized page once they are accessed
+	QModelIndex insertPage(int beforeIdx, const QDomElement& pageElement, const QByteArray& pageXml, int childCount, const HOCRPageWords& words, const QString& sourceBasePath = QString());
+	// Inserts a page of a project whose items are only read once they are accessed
+	QModelIndex insertPage(int beforeIdx, const QSharedPointer<HOCRProject>& project, int projectPage, const QString& sourceBasePath = QString());
+	// Parses the page divs of data located by HOCRReader::splitPages in parallel and inserts them in order.
+	// progress is called with the number of pages read so far after each batch, and returns false to cancel.
+	// Returns false if a page is malformed, inserted is set to the number of inserted pages in any case.
+	bool insertPages(int beforeIdx, const QByteArray& data, const QVector<QPair<int, int>>& pages, const QString& sourceBasePath, const std::function<bool(int pagesRead)>& progress, int& inserted);
+	// Pages inserted between these calls are added to the model in batches, insertPage then returns an invalid index
+	void beginInsertPages();
+	void endInsertPages();
 	const HOCRPage* page(int i) const {
 		return m_pages.value(i);
 	}
@@ -77,6 +114,17 @@ public:
 	bool indexIsMisspelledWord(const QModelIndex& index) const;
 	bool getItemSpellingSuggestions(const QModelIndex& index, QString& trimmedWord, QStringList& suggestions, int limit) const;
 
+	// Pages which may contain the text, as a superset since the lookup ignores case and diacritics
+	QSet<const HOCRPage*> pagesContainingText(const QString& text) const {
+		return m_wordIndex.pagesContaining(text);
+	}
+	QSet<const HOCRPage*> pagesContainingAnyText(const QStringList& texts) const {
+		return m_wordIndex.pagesContainingAny(texts);
+	}
+	// Rewrites the texts of the words below index for which replace returns true, returns their number.
+	// Change notifications are emitted once per range of sibling items rather than per word.
+	int replaceWordTexts(const QModelIndex& index, const std::function<bool(QString& text)>& replace);
+
 	bool referencesSource(const QString& filename) const;
 	QModelIndex searchPage(const QString& filename, int pageNr) const;
 	QModelIndex searchAtCanvasPos(const QModelIndex& pageIndex, const QPoint& pos) const;
@@ -89,16 +137,69 @@ public:
 	QModelIndex parent(const QModelIndex& child) const override;
 	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
 	int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+	bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+
+	// Prevents pages from being evicted while the document is traversed outside of the model, i.e. by exporters
+	class EvictionBlocker {
+	public:
+		EvictionBlocker(const HOCRDocument* document) : m_document(document) {
+			m_document->m_evictionBlockers.ref();
+		}
+		~EvictionBlocker() {
+			m_document->m_evictionBlockers.deref();
+		}
+	private:
+		const HOCRDocument* m_document;
+	};
 
 signals:
 	void itemAttributeChanged(const QModelIndex& itemIndex, const QString& name, const QString& value);
+	void pageModified(int pageId);
 
 private:
 	int m_pageIdCounter = 0;
 	QString m_defaultLanguage = "en_US";
-	HOCRSpellChecker* m_spell;
+	HOCRSpellCheckerPool* m_spell;
 
 	QVector<HOCRPage*> m_pages;
+	int m_pageBatchDepth = 0;
+	int m_pendingPagesPos = 0;
+	QVector<HOCRPage*> m_pendingPages;
+	QTimer m_pageBatchTimer;
+	QTimer m_pageNumberingTimer;
+	mutable QAtomicInt m_evictionBlockers;
+	HOCRWordIndex m_wordIndex;
+
+	// Spelling results by language and word, words which are not cached yet are checked in the background
+	mutable QMutex m_spellCacheMutex;
+	mutable QHash<QString, QHash<QString, bool>> m_spellCache;
+	mutable int m_spellCacheGeneration = 0;
+	mutable QList<QPair<QString, QString>> m_spellQueue;
+	mutable QSet<QPair<QString, QString>> m_spellQueued;
+	mutable QSet<QPersistentModelIndex> m_spellPending;
+	mutable QTimer m_spellCheckTimer;
+	QFutureWatcher<void> m_spellCheckWatcher;
+
+	// Interval at which batched pages are added and page titles are refreshed
+	static constexpr int s_pageUpdateInterval = 100;
+	// Maximum number of words looked up per background spell checking batch
+	static constexpr int s_spellCheckBatchSize = 500;
+	// Number of pages parsed per worker thread and batch when opening documents
+	static constexpr int s_parseBatchSize = 16;
+	// Pages are evicted after having been unused for this many ticks of the eviction timer
+	static constexpr int s_evictionInterval = 30000;
+	static constexpr int s_evictionTicks = 4;
+
+	QModelIndex insertPageItem(int beforeIdx, HOCRPage* page, const QString& sourceBasePath);
+	void flushPendingPages();
+	void updatePageNumbering();
+	void evictIdlePages();
+	void setPageModified(const HOCRItem* item);
+	bool pageMayContainMatches(const HOCRPage* page, bool misspelled, bool lowconf) const;
+	bool pageWordsMisspelled(const HOCRPage* page) const;
+	void indexWords(HOCRPage* page, const HOCRItem* item, bool add);
+	void replaceWordTexts(const QModelIndex& index, const std::function<bool(QString& text)>& replace, QList<QModelIndex>& changed, int& count);
+	void emitDataChanged(const QList<QModelIndex>& indices, const QVector<int>& roles);
 
 	QString displayRoleForItem(const HOCRItem* item) const;
 	QIcon decorationRoleForItem(const HOCRItem* item) const;
@@ -108,7 +209,11 @@ private:
 	void deleteItem(HOCRItem* item);
 	void takeItem(HOCRItem* item);
 	void resetMisspelled(const QModelIndex& index);
-	QList<QModelIndex> recheckItemSpelling(const QModelIndex& index) const;
+	void clearSpellCache();
+	QList<QModelIndex> recheckItemSpelling(const QModelIndex& index, bool wait = true) const;
+	int lookupSpelling(const QString& lang, const QString& word, bool wait) const;
+	void startSpellCheckBatch();
+	void spellCheckBatchFinished();
 	void recomputeBBoxes(HOCRItem* item);
 	HOCRItem* mutableItemAtIndex(const QModelIndex& index) const {
 		return index.isValid() ? static_cast<HOCRItem*> (index.internalPointer()) : nullptr;
@@ -121,14 +226,14 @@ public:
 	// attrname : attrvalue : occurrences
 	typedef QMap<QString, QMap<QString, int >> AttrOccurenceMap_t;
 
+	enum class ItemClass : quint8 { Other, Page, CArea, Par, Line, Word, Graphic, Photo, Separator };
+
 	HOCRItem(const QDomElement& element, HOCRPage* page, HOCRItem* parent, int index = -1);
 	virtual ~HOCRItem();
 	HOCRPage* page() const {
 		return m_pageItem;
 	}
-	const QVector<HOCRItem*>& children() const {
-		return m_childItems;
-	}
+	const QVector<HOCRItem*>& children() const;
 	HOCRItem* parent() const {
 		return m_parentItem;
 	}
@@ -140,9 +245,10 @@ public:
 	}
 
 	// HOCR specific convenience getters
-	QString itemClass() const {
-		return m_attrs["class"];
+	ItemClass itemClassId() const {
+		return m_itemClass;
 	}
+	QString itemClass() const;
 	const QRect& bbox() const {
 		return m_bbox;
 	}
@@ -150,7 +256,7 @@ public:
 		return m_text;
 	}
 	QString lang() const {
-		return m_attrs["lang"];
+		return attrValue(HtmlAttrs, KeyLang);
 	}
 	QString spellingLang() const {
 		QString l = lang();
@@ -158,22 +264,25 @@ public:
 		return code.isEmpty() ? l : code;
 	}
 	const QMap<QString, QString> getAttributes() const {
-		return m_attrs;
+		return attrMap(HtmlAttrs);
 	}
 	const QMap<QString, QString> getTitleAttributes() const {
-		return m_titleAttrs;
+		return attrMap(TitleAttrs);
 	}
 	QMap<QString, QString> getAllAttributes() const;
 	QMap<QString, QString> getAttributes(const QList<QString>& names) const;
 	void getPropagatableAttributes(QMap<QString, QMap<QString, QSet<QString >>> & occurrences) const;
 	QString toHtml(int indent = 0) const;
+	void writeHtml(QString& html, int indent) const;
+	// The parts of writeHtml, for writing the element separately from its content
+	void writeHtmlStartTag(QString& html, int indent) const;
+	void writeHtmlEndTag(QString& html, int indent) const;
 	QPair<double, double> baseLine() const;
 	QString fontFamily() const {
-		return m_titleAttrs["x_font"];
-	}
-	double fontSize() const {
-		return m_titleAttrs["x_fsize"].toDouble();
+		return attrValue(TitleAttrs, KeyFont);
 	}
+	double fontSize() const;
+	int wordConfidence() const;
 	bool fontBold() const {
 		return m_bold;
 	}
@@ -188,27 +297,54 @@ public:
 protected:
 	friend class HOCRDocument;
 	friend class HOCRPage;
+	friend class HOCRProject;
+	friend class HOCRProjectWriter;
+
+	// Attribute names are interned, items only store their key. The first keys are predefined, in
+	// alphabetical order, so that known attributes serialize in the same order as a QMap would.
+	typedef quint16 AttrKey;
+	enum KnownAttrKey : AttrKey { KeyBaseline, KeyBBox, KeyClass, KeyId, KeyImage, KeyLang, KeyPageNo, KeyPPageNo, KeyRot, KeyScanRes, KeyAscenders, KeyDescenders, KeyFont, KeyFontSize, KeySize, KeyWConf };
+	enum AttrGroup { HtmlAttrs, TitleAttrs };
+	struct AttrEntry {
+		AttrKey key;
+		// Whether the value is held in the corresponding typed member (m_itemClass, m_bbox, ...) rather than in the string
+		bool typed;
+		QString value;
+	};
 
 	static QMap<QString, QString> s_langCache;
 
+	// The language of the words below an element with the given lang attribute
+	static QString inheritedLanguage(const QString& elemLang, const QString& defaultLanguage);
+
 	QString m_text;
 	int m_misspelled = -1;
 	bool m_bold;
 	bool m_italic;
+	bool m_enabled = true;
+	ItemClass m_itemClass = ItemClass::Other;
 
-	QMap<QString, QString> m_attrs;
-	QMap<QString, QString> m_titleAttrs;
+	// Sorted by key
+	QVector<AttrEntry> m_attrs;
+	QVector<AttrEntry> m_titleAttrs;
 	QVector<HOCRItem*> m_childItems;
 	HOCRPage* m_pageItem = nullptr;
 	HOCRItem* m_parentItem = nullptr;
 	int m_index;
-	bool m_enabled = true;
 
 	QRect m_bbox;
+	float m_baseline[2] = {0, 0};
+	float m_fontSize = 0;
+	float m_size = 0;
+	int m_wconf = 0;
+
+	// Constructs an empty item, used when reading projects
+	HOCRItem(HOCRPage* page, HOCRItem* parent, int index);
 
 	// All mutations must be done through methods of HOCRDocument
 	void addChild(HOCRItem* child);
 	void insertChild(HOCRItem* child, int i);
+	void setPage(HOCRPage* page);
 	void removeChild(HOCRItem* child);
 	void takeChild(const HOCRItem* child);
 	QVector<HOCRItem*> takeChildren();
@@ -218,20 +354,45 @@ protected:
 	void setText(const QString& newText) {
 		m_text = newText;
 	}
-	void setMisspelled(int misspelled) {
-		m_misspelled = misspelled;
-	}
+	void setMisspelled(int misspelled);
 	int isMisspelled() const {
 		return m_misspelled;
 	}
 	void setAttribute(const QString& name, const QString& value, const QString& attrItemClass = QString());
 	bool parseChildren(const QDomElement& element, QString language, const QString& defaultLanguage);
+	void assignId();
+
+	static AttrKey internKey(const QString& name);
+	static int lookupKey(const QString& name);
+	static const QString& keyName(AttrKey key);
+	static QString internValue(const QString& value);
+	static bool attrKeyLess(const AttrEntry& attr, AttrKey key) {
+		return attr.key < key;
+	}
+	// The indices of the entries in the order of their names, in which they are written
+	static void attrWriteOrder(const QVector<AttrEntry>& attrs, QVarLengthArray<int, 16>& order);
+	const AttrEntry* findAttr(AttrGroup group, AttrKey key) const;
+	bool hasAttr(AttrGroup group, AttrKey key) const {
+		return findAttr(group, key) != nullptr;
+	}
+	QString attrValue(AttrGroup group, AttrKey key, const QString& defaultValue = QString()) const;
+	void setAttr(AttrGroup group, AttrKey key, const QString& value);
+	void removeAttr(AttrGroup group, AttrKey key);
+	QMap<QString, QString> attrMap(AttrGroup group) const;
+	void writeTitleAttrs(QString& string) const;
+	QString typedValue(AttrKey key) const;
+	void appendTypedValue(QString& string, AttrKey key) const;
+	bool setTypedValue(AttrKey key, const QString& value);
 };
 
 
 class HOCRPage : public HOCRItem {
 public:
 	HOCRPage(const QDomElement& element, int pageId, const QString& defaultLanguage, bool cleanGraphics, int index);
+	// Constructs a page whose items are parsed from pageXml on first access
+	HOCRPage(const QDomElement& element, const QByteArray& pageXml, int childCount, const HOCRPageWords& words, int pageId, const QString& defaultLanguage, int index);
+	// Constructs a page whose items are read from the project on first access
+	HOCRPage(const QSharedPointer<HOCRProject>& project, int projectPage, int pageId, const QString& defaultLanguage, int index);
 
 	const QString& sourceFile() const {
 		return m_sourceFile;
@@ -250,10 +411,15 @@ public:
 		return m_pageId;
 	}
 	QString title() const;
+	int childCount() const;
+	const HOCRSpatialIndex& spatialIndex() const;
 
 private:
 	friend class HOCRItem;
 	friend class HOCRDocument;
+	friend class HOCRWordIndex;
+	friend class HOCRProject;
+	friend class HOCRProjectWriter;
 
 	int m_pageId;
 	QMap<QString, int> m_idCounters;
@@ -262,8 +428,54 @@ private:
 	double m_angle;
 	int m_resolution;
 
+	// Compressed serialized page, kept as long as the page is unmodified so that its items can be dropped when unused
+	QByteArray m_pageXml;
+	// Likewise, the project page the items can be read from
+	QSharedPointer<HOCRProject> m_project;
+	int m_projectPage = -1;
+	QString m_defaultLanguage;
+	int m_childCount = 0;
+	mutable QAtomicInt m_loaded = 1;
+	mutable int m_lastAccess = 0;
+	// Built on first use, kept up to date by HOCRDocument when items are added, removed or resized
+	mutable HOCRSpatialIndex m_spatialIndex;
+	// Normalized word : occurrences, kept while the items are not loaded
+	QHash<QString, int> m_wordCounts;
+	// Word statistics for skipping pages when navigating, recounted after the page changed.
+	// The spelling counts are kept up to date as the spelling of words is checked.
+	mutable bool m_wordStatsValid = false;
+	mutable int m_lowConfidenceWords = 0;
+	mutable int m_misspelledWords = 0;
+	mutable int m_uncheckedWords = 0;
+	// Distinct trimmed words by language, so that the spelling of pages can be checked without loading them.
+	// Collected when the page is read, or from the project on first use, and dropped once the page is modified.
+	enum class SpellingWords { Unknown, ByLangAttribute, ByLanguage };
+	mutable SpellingWords m_spellingWordsKey = SpellingWords::Unknown;
+	mutable QHash<QString, QStringList> m_spellingWords;
+
+	void initPage();
+	void countWords(const HOCRItem* item);
+	void ensureWordStats() const;
+	void countWordStats(const HOCRItem* item) const;
+	// Returns nullptr if the words are not known
+	const QHash<QString, QStringList>* spellingWords() const;
+	void parsePage(const QDomElement& element, const QString& defaultLanguage, bool cleanGraphics);
 	void convertSourcePath(const QString& basepath, bool absolute);
+	void ensureLoaded() const;
+	void load();
+	bool unload();
+	void setModified();
+	void setProject(const QSharedPointer<HOCRProject>& project, int projectPage);
+	static int advanceAccessTick();
 };
 
+inline const QVector<HOCRItem*>& HOCRItem::children() const {
+	// The items of pages are parsed on demand
+	if (m_pageItem == this) {
+		m_pageItem->ensureLoaded();
+	}
+	return m_childItems;
+}
+
 
 #endif // HOCRDOCUMENT_HH
@@ -0,0 +1,525 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRJournal.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QDomElement>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrentRun>
+#include <QtEndian>
+
+#include "GzipDevice.hh"
+#include "HOCRDocument.hh"
+#include "HOCRJournal.hh"
+#include "HOCRProject.hh"
+#include "HOCRReader.hh"
+#include "Utils.hh"
+
+// Each record is stored as a length prefixed byte array, so that a record
+// which was only partially written before a crash can be detected and skipped
+enum JournalRecordType : quint8 { PageRecord = 1, OrderRecord = 2, SourceRecord = 3 };
+
+static QByteArray pageRecord(quint32 pageId, const QByteArray& startTag, const QByteArray& children) {
+	QByteArray record;
+	QDataStream out(&record, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_15);
+	out << quint8(PageRecord) << pageId << startTag << children;
+	return record;
+}
+
+static QByteArray orderRecord(const QVector<quint32>& order) {
+	QByteArray record;
+	QDataStream out(&record, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_15);
+	out << quint8(OrderRecord) << order;
+	return record;
+}
+
+static QByteArray sourceRecord(quint32 pageId, const QString& filename, qint64 fileSize, const QDateTime& modified, qint32 page) {
+	QByteArray record;
+	QDataStream out(&record, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_15);
+	out << quint8(SourceRecord) << pageId << filename << fileSize << modified << page;
+	return record;
+}
+
+
+HOCRJournal::HOCRJournal(HOCRDocument* document, QObject* parent)
+	: QObject(parent), m_document(document), m_dir(journalDir(QCoreApplication::applicationPid())), m_lock(m_dir + "/lock") {
+	QDir().mkpath(m_dir);
+	// A leftover lock of a previous session with the same pid
+	QFile::remove(m_lock.fileName());
+	m_lock.setStaleLockTime(0);
+	m_lock.tryLock(0);
+	reset();
+
+	connect(m_document, &HOCRDocument::pageModified, this, [this](int pageId) {
+		m_dirtyPages.insert(pageId);
+	});
+	connect(m_document, &HOCRDocument::rowsInserted, this, [this](const QModelIndex& parent, int first, int last) {
+		if (!parent.isValid()) {
+			// Pages read from a file are only serialized once they are modified, see addSourcePages
+			if (m_loadDepth == 0) {
+				for (int i = first; i <= last; ++i) {
+					m_dirtyPages.insert(m_document->page(i)->pageId());
+				}
+			}
+			m_orderDirty = true;
+		}
+	});
+	connect(m_document, &HOCRDocument::rowsAboutToBeRemoved, this, [this](const QModelIndex& parent, int first, int last) {
+		if (!parent.isValid()) {
+			for (int i = first; i <= last; ++i) {
+				m_dirtyPages.remove(m_document->page(i)->pageId());
+				m_sourcePages.remove(m_document->page(i)->pageId());
+			}
+			m_orderDirty = true;
+		}
+	});
+	connect(m_document, &HOCRDocument::rowsMoved, this, [this](const QModelIndex& parent, int /*start*/, int /*end*/, const QModelIndex& destination) {
+		m_orderDirty |= !parent.isValid() || !destination.isValid();
+	});
+	connect(m_document, &HOCRDocument::modelReset, this, &HOCRJournal::reset);
+
+	m_flushTimer.setInterval(s_flushInterval);
+	connect(&m_flushTimer, &QTimer::timeout, this, [this] { flush(s_flushBudget); });
+	m_flushTimer.start();
+}
+
+HOCRJournal::~HOCRJournal() {
+	m_flushTimer.stop();
+	m_compactWatcher.waitForFinished();
+	m_journalFile.close();
+	m_lock.unlock();
+	// The journal is only needed to recover from a crash
+	QDir(m_dir).removeRecursively();
+}
+
+QString HOCRJournal::journalDir(qint64 pid) {
+	return QString("%1/hocr-journal-%2").arg(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).arg(pid);
+}
+
+void HOCRJournal::addSourcePages(const QString& filename, int firstRow, int count) {
+	QFileInfo info(filename);
+	SourcePage sourcePage{info.absoluteFilePath(), info.size(), info.lastModified(), 0};
+	for (int i = 0; i < count; ++i) {
+		sourcePage.page = i;
+		m_sourcePages.insert(m_document->page(firstRow + i)->pageId(), sourcePage);
+	}
+}
+
+void HOCRJournal::flush(int timeBudget) {
+	if (m_dirtyPages.isEmpty() && m_sourcePages.isEmpty() && !m_orderDirty) {
+		return;
+	}
+	if (!m_journalFile.isOpen() && !openJournal()) {
+		return;
+	}
+	QElapsedTimer timer;
+	timer.start();
+
+	// References are small, and superseded by the page records of modified pages
+	for (auto it = m_sourcePages.constBegin(), itEnd = m_sourcePages.constEnd(); it != itEnd; ++it) {
+		appendRecord(sourceRecord(it.key(), it->filename, it->fileSize, it->modified, it->page));
+	}
+	m_sourcePages.clear();
+	if (!m_dirtyPages.isEmpty()) {
+		QHash<int, int> pageRows;
+		for (int i = 0, n = m_document->pageCount(); i < n; ++i) {
+			pageRows.insert(m_document->page(i)->pageId(), i);
+		}
+		QString html;
+		for (auto it = m_dirtyPages.begin(); it != m_dirtyPages.end();) {
+			// Pages which were removed in the meantime are dropped with the next order record
+			int row = pageRows.value(*it, -1);
+			if (row >= 0) {
+				// The start tag is kept apart, so that the crash handler can write it from memory with relative paths
+				html.clear();
+				m_document->page(row)->writeHtmlStartTag(html, 1);
+				QByteArray startTag = html.toUtf8();
+				html.clear();
+				m_document->writePageChildrenHtml(row, html);
+				appendRecord(pageRecord(*it, startTag, qCompress(html.toUtf8())));
+			}
+			it = m_dirtyPages.erase(it);
+			if (timeBudget >= 0 && timer.elapsed() > timeBudget) {
+				break;
+			}
+		}
+	}
+	if (m_orderDirty) {
+		QVector<quint32> order;
+		order.reserve(m_document->pageCount());
+		for (int i = 0, n = m_document->pageCount(); i < n; ++i) {
+			order.append(m_document->page(i)->pageId());
+		}
+		appendRecord(orderRecord(order));
+		m_orderDirty = false;
+	}
+
+	if (m_journalFile.size() > qMax(s_minCompactSize, QFileInfo(filePath("snapshot")).size())) {
+		compact();
+	}
+}
+
+bool HOCRJournal::replay(QIODevice* device) const {
+	// Snapshots and journals are only replaced or removed as a whole and records hold absolute page states, so a running
+	// compaction does not need to be waited for. The files are kept open, so that they remain readable meanwhile.
+	static const char* const fileNames[] = {"snapshot", "journal.old", "journal"};
+	QFile files[3];
+	QHash<quint32, RecordLocation> records;
+	for (int i = 0; i < 3; ++i) {
+		files[i].setFileName(filePath(fileNames[i]));
+		if (files[i].open(QIODevice::ReadOnly)) {
+			indexRecords(files[i], i, records);
+		}
+	}
+	if (device->write("<body>\n") < 0) {
+		return false;
+	}
+	QString html;
+	QByteArray children;
+	for (int row = 0, n = m_document->pageCount(); row < n; ++row) {
+		const HOCRPage* page = m_document->page(row);
+		quint32 pageId = page->pageId();
+		// Pages modified since the last flush and pages without a record are serialized, exactly as by writeHTML
+		bool haveChildren = false;
+		auto recordIt = records.constFind(pageId);
+		if (recordIt != records.constEnd() && !m_dirtyPages.contains(pageId)) {
+			QFile& file = files[recordIt->file];
+			haveChildren = file.seek(recordIt->offset) && (children = file.read(recordIt->size)).size() == recordIt->size;
+			children = qUncompress(children);
+		}
+		html.clear();
+		if (haveChildren) {
+			page->writeHtmlStartTag(html, 1);
+			html += "\n";
+			if (device->write(html.toUtf8()) < 0 || device->write(children) < 0) {
+				return false;
+			}
+			html.clear();
+			page->writeHtmlEndTag(html, 1);
+		} else {
+			m_document->writePageHtml(row, html);
+		}
+		if (device->write(html.toUtf8()) < 0) {
+			return false;
+		}
+	}
+	return device->write("</body>\n") >= 0;
+}
+
+void HOCRJournal::reset() {
+	m_compactWatcher.waitForFinished();
+	m_journalFile.close();
+	QFile::remove(filePath("snapshot"));
+	QFile::remove(filePath("journal.old"));
+	QFile::remove(filePath("journal"));
+	m_dirtyPages.clear();
+	m_sourcePages.clear();
+	m_orderDirty = false;
+}
+
+QStringList HOCRJournal::recoverAbandonedJournals(const QString& defaultLanguage) {
+	QStringList recovered;
+	QString ownDir = QFileInfo(journalDir(QCoreApplication::applicationPid())).absoluteFilePath();
+	for (const QFileInfo& info : QFileInfo(ownDir).absoluteDir().entryInfoList({"hocr-journal-*"}, QDir::Dirs | QDir::NoDotAndDotDot)) {
+		if (info.absoluteFilePath() == ownDir) {
+			continue;
+		}
+		// The lock of a journal can only be acquired once the session which created it is not running anymore
+		QLockFile lock(info.absoluteFilePath() + "/lock");
+		lock.setStaleLockTime(0);
+		if (!lock.tryLock(0)) {
+			continue;
+		}
+		QString filename = Utils::makeOutputFilename(QDir(Utils::documentsFolder()).absoluteFilePath(QString("%1_crash-save.html").arg(PACKAGE_NAME)));
+		int pages = recoverJournal(info.absoluteFilePath(), filename, defaultLanguage);
+		if (pages > 0) {
+			recovered.append(filename);
+		}
+		lock.unlock();
+		// Kept for the next attempt if the recovered file could not be written
+		if (pages >= 0) {
+			QDir(info.absoluteFilePath()).removeRecursively();
+		}
+	}
+	return recovered;
+}
+
+int HOCRJournal::recoverJournal(const QString& dir, const QString& filename, const QString& defaultLanguage) {
+	QHash<quint32, QByteArray> records;
+	QVector<quint32> order;
+	for (const char* name : {"snapshot", "journal.old", "journal"}) {
+		readRecords(dir + "/" + name, records, order);
+	}
+
+	// Unmodified pages are read again from their files, provided these did not change meanwhile
+	struct SourceFile {
+		qint64 size;
+		QDateTime modified;
+		QMap<int, quint32> pages;
+	};
+	QMap<QString, SourceFile> sourceFiles;
+	for (quint32 pageId : order) {
+		QDataStream in(records.value(pageId));
+		in.setVersion(QDataStream::Qt_5_15);
+		quint8 type = 0;
+		quint32 recordPageId = 0;
+		QString sourceFilename;
+		qint64 size = 0;
+		QDateTime modified;
+		qint32 page = 0;
+		in >> type >> recordPageId;
+		if (type == SourceRecord) {
+			in >> sourceFilename >> size >> modified >> page;
+			if (in.status() == QDataStream::Ok) {
+				SourceFile& sourceFile = sourceFiles[sourceFilename];
+				sourceFile.size = size;
+				sourceFile.modified = modified;
+				sourceFile.pages.insert(page, pageId);
+			}
+		}
+	}
+	HOCRDocument sourceDocument;
+	sourceDocument.setDefaultLanguage(defaultLanguage);
+	QHash<quint32, int> sourceRows;
+	sourceDocument.beginInsertPages();
+	for (auto it = sourceFiles.constBegin(), itEnd = sourceFiles.constEnd(); it != itEnd; ++it) {
+		QFileInfo info(it.key());
+		if (info.size() == it->size && info.lastModified() == it->modified) {
+			readSourcePages(it.key(), it->pages, sourceDocument, sourceRows);
+		}
+	}
+	sourceDocument.endInsertPages();
+
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return -1;
+	}
+	QString header = QString(
+	                     "<!DOCTYPE html>\n"
+	                     "<html>\n"
+	                     "<head>\n"
+	                     " <title>%1</title>\n"
+	                     " <meta charset=\"utf-8\" /> \n"
+	                     " <meta name='ocr-capabilities' content='ocr_page ocr_carea ocr_par ocr_line ocrx_word'/>\n"
+	                     "</head>\n"
+	                     "<body>\n").arg(QFileInfo(filename).fileName());
+	bool success = file.write(header.toUtf8()) >= 0;
+	int recovered = 0;
+	QString html;
+	for (int i = 0, n = order.size(); i < n && success; ++i) {
+		QDataStream in(records.value(order[i]));
+		in.setVersion(QDataStream::Qt_5_15);
+		quint8 type = 0;
+		quint32 pageId = 0;
+		in >> type >> pageId;
+		if (type == PageRecord) {
+			QByteArray startTag;
+			QByteArray children;
+			in >> startTag >> children;
+			if (in.status() == QDataStream::Ok) {
+				success = file.write(startTag + "\n" + qUncompress(children) + " </div>\n") >= 0;
+				++recovered;
+			}
+		} else if (type == SourceRecord && sourceRows.contains(order[i])) {
+			html.clear();
+			sourceDocument.writePageHtml(sourceRows.value(order[i]), html);
+			success = file.write(html.toUtf8()) >= 0;
+			++recovered;
+		}
+	}
+	success = success && file.write("</body>\n</html>\n") >= 0;
+	file.close();
+	if (!success || recovered == 0) {
+		file.remove();
+		return success ? 0 : -1;
+	}
+	return recovered;
+}
+
+void HOCRJournal::readSourcePages(const QString& filename, const QMap<int, quint32>& pages, HOCRDocument& document, QHash<quint32, int>& rows) {
+	QString basePath = QFileInfo(filename).absolutePath();
+	if (filename.endsWith(".ghocr", Qt::CaseInsensitive)) {
+		QSharedPointer<HOCRProject> project = HOCRProject::open(filename);
+		for (auto it = pages.constBegin(), itEnd = pages.constEnd(); project && it != itEnd && it.key() < project->pageCount(); ++it) {
+			rows.insert(it.value(), rows.size());
+			document.insertPage(rows.size() - 1, project, it.key(), basePath);
+		}
+		return;
+	}
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	GzipDevice gzipDevice(&file);
+	bool compressed = GzipDevice::isGzipFile(filename);
+	if (compressed && !gzipDevice.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	HOCRReader reader(compressed ? static_cast<QIODevice*> (&gzipDevice) : &file);
+	QDomElement div;
+	QByteArray pageXml;
+	int childCount = 0;
+	HOCRPageWords words;
+	for (int page = 0, lastPage = pages.lastKey(); page <= lastPage && !(div = reader.readNextPage(pageXml, childCount, words)).isNull(); ++page) {
+		auto it = pages.constFind(page);
+		if (it != pages.constEnd()) {
+			rows.insert(it.value(), rows.size());
+			document.insertPage(rows.size() - 1, div, pageXml, childCount, words, basePath);
+		}
+	}
+}
+
+bool HOCRJournal::openJournal() {
+	// Unbuffered, so that appended records are in the file even if the process crashes right after
+	m_journalFile.setFileName(filePath("journal"));
+	return m_journalFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered);
+}
+
+void HOCRJournal::appendRecord(const QByteArray& record) {
+	QByteArray framed;
+	QDataStream out(&framed, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_15);
+	out << record;
+	m_journalFile.write(framed);
+}
+
+void HOCRJournal::compact() {
+	if (m_compactWatcher.isRunning()) {
+		return;
+	}
+	// A leftover journal from a failed compaction is folded first, new records keep going to the current journal
+	if (!QFile::exists(filePath("journal.old"))) {
+		m_journalFile.close();
+		bool rotated = QFile::rename(filePath("journal"), filePath("journal.old"));
+		if (!openJournal() || !rotated) {
+			return;
+		}
+	}
+	QString dir = m_dir;
+	m_compactWatcher.setFuture(QtConcurrent::run([dir] {
+		return foldJournal(dir);
+	}));
+}
+
+void HOCRJournal::indexRecords(QFile& file, int fileIndex, QHash<quint32, RecordLocation>& records) {
+	// Only the record headers are read: the QDataStream length prefix of the record, its type, the page id,
+	// the start tag and the length prefix of the serialized items, see pageRecord
+	uchar header[13];
+	qint64 pos = 0;
+	qint64 size = file.size();
+	while (pos + 4 <= size && file.seek(pos) && file.read(reinterpret_cast<char*> (header), 4) == 4) {
+		quint32 length = qFromBigEndian<quint32> (header);
+		if (length == 0xFFFFFFFF) {
+			pos += 4;
+			continue;
+		}
+		if (pos + 4 + length > size) {
+			// Truncated record at the end of the file
+			break;
+		}
+		if (length >= 9 && file.read(reinterpret_cast<char*> (header + 4), 9) == 9 && header[4] == PageRecord) {
+			quint32 pageId = qFromBigEndian<quint32> (header + 5);
+			quint32 startTagLength = qFromBigEndian<quint32> (header + 9);
+			qint64 childrenPos = pos + 13 + (startTagLength == 0xFFFFFFFF ? 0 : startTagLength);
+			if (childrenPos + 4 <= pos + 4 + length && file.seek(childrenPos) && file.read(reinterpret_cast<char*> (header), 4) == 4) {
+				quint32 childrenLength = qFromBigEndian<quint32> (header);
+				if (childrenLength != 0xFFFFFFFF && childrenPos + 4 + childrenLength <= pos + 4 + length) {
+					records.insert(pageId, RecordLocation{fileIndex, childrenPos + 4, childrenLength});
+				}
+			}
+		}
+		pos += 4 + length;
+	}
+}
+
+bool HOCRJournal::readRecords(const QString& filename, QHash<quint32, QByteArray>& pages, QVector<quint32>& order) {
+	QFile file(filename);
+	if (!file.exists()) {
+		return true;
+	}
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_5_15);
+	while (!in.atEnd()) {
+		QByteArray record;
+		in >> record;
+		if (in.status() != QDataStream::Ok) {
+			// Truncated record at the end of the file
+			break;
+		}
+		QDataStream recordIn(record);
+		recordIn.setVersion(QDataStream::Qt_5_15);
+		quint8 type = 0;
+		recordIn >> type;
+		if (type == PageRecord || type == SourceRecord) {
+			// Page and source records are kept as they are, the latest one of a page wins
+			quint32 pageId = 0;
+			recordIn >> pageId;
+			if (recordIn.status() == QDataStream::Ok) {
+				pages[pageId] = record;
+			}
+		} else if (type == OrderRecord) {
+			QVector<quint32> recordOrder;
+			recordIn >> recordOrder;
+			if (recordIn.status() == QDataStream::Ok) {
+				order = recordOrder;
+			}
+		}
+	}
+	return true;
+}
+
+bool HOCRJournal::writeSnapshot(const QString& filename, const QHash<quint32, QByteArray>& pages, const QVector<quint32>& order) {
+	QSaveFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_5_15);
+	for (quint32 pageId : order) {
+		auto it = pages.find(pageId);
+		if (it != pages.end()) {
+			out << it.value();
+		}
+	}
+	out << orderRecord(order);
+	return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool HOCRJournal::foldJournal(const QString& dir) {
+	QHash<quint32, QByteArray> pages;
+	QVector<quint32> order;
+	if (!readRecords(dir + "/snapshot", pages, order) || !readRecords(dir + "/journal.old", pages, order)) {
+		return false;
+	}
+	// Records of pages which are not part of the document anymore are dropped by only writing the ordered pages
+	if (!writeSnapshot(dir + "/snapshot", pages, order)) {
+		return false;
+	}
+	return QFile::remove(dir + "/journal.old");
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRJournal.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOCRJOURNAL_HH
+#define HOCRJOURNAL_HH
+
+#include <QDateTime>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QLockFile>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+class QIODevice;
+class HOCRDocument;
+
+/**
+ * Append-only autosave journal of a document. Whenever a page is edited or
+ * newly created, the serialized page is appended to the journal in the
+ * background, as is the page order whenever it changes. Pages read from a
+ * file are not serialized unless they are modified, they are recorded as a
+ * reference to the file and their position in it. Once the journal has grown
+ * large enough it is folded into a snapshot in a worker thread.
+ *
+ * The records are self-contained, so the journal of a session which did not
+ * terminate properly is recovered to a hOCR file by the next session. The
+ * crash handler copies the pages which have a current record from the
+ * journal, so that only the others need to be serialized.
+ */
+class HOCRJournal : public QObject {
+	Q_OBJECT
+
+public:
+	HOCRJournal(HOCRDocument* document, QObject* parent = nullptr);
+	~HOCRJournal();
+
+	// Pages inserted between beginLoad and endLoad are read from files rather than created
+	void beginLoad() {
+		++m_loadDepth;
+	}
+	void endLoad() {
+		--m_loadDepth;
+	}
+	// Records the pages at firstRow, firstRow + 1, ... as unmodified copies of the first count pages of the file
+	void addSourcePages(const QString& filename, int firstRow, int count);
+	// Appends the pending changes to the journal, stops after timeBudget ms unless negative
+	void flush(int timeBudget = -1);
+	// Writes the body of the document to the device like HOCRDocument::writeHTML. Does not wait
+	// for a running compaction, so that it can be used from the crash handler.
+	bool replay(QIODevice* device) const;
+	// Discards the journal, i.e. after the document was cleared
+	void reset();
+
+	// Recovers the journals left behind by sessions which did not terminate properly to hOCR files
+	// in the documents folder and removes them. Returns the recovered files.
+	static QStringList recoverAbandonedJournals(const QString& defaultLanguage);
+
+private:
+	static constexpr int s_flushInterval = 5000;
+	static constexpr int s_flushBudget = 20;
+	static constexpr qint64 s_minCompactSize = 4 * 1024 * 1024;
+
+	struct SourcePage {
+		QString filename;
+		qint64 fileSize;
+		QDateTime modified;
+		int page;
+	};
+	struct RecordLocation {
+		int file;
+		qint64 offset;
+		qint64 size;
+	};
+
+	HOCRDocument* m_document;
+	QString m_dir;
+	// Held for the lifetime of the journal, so that other sessions can tell abandoned journals apart
+	QLockFile m_lock;
+	QFile m_journalFile;
+	QSet<int> m_dirtyPages;
+	// Source references which were not appended yet
+	QHash<int, SourcePage> m_sourcePages;
+	bool m_orderDirty = false;
+	int m_loadDepth = 0;
+	QTimer m_flushTimer;
+	QFutureWatcher<bool> m_compactWatcher;
+
+	QString filePath(const QString& name) const {
+		return m_dir + "/" + name;
+	}
+	bool openJournal();
+	void appendRecord(const QByteArray& record);
+	void compact();
+
+	static QString journalDir(qint64 pid);
+	static int recoverJournal(const QString& dir, const QString& filename, const QString& defaultLanguage);
+	static void readSourcePages(const QString& filename, const QMap<int, quint32>& pages, HOCRDocument& document, QHash<quint32, int>& rows);
+	static void indexRecords(QFile& file, int fileIndex, QHash<quint32, RecordLocation>& records);
+	static bool readRecords(const QString& filename, QHash<quint32, QByteArray>& pages, QVector<quint32>& order);
+	static bool writeSnapshot(const QString& filename, const QHash<quint32, QByteArray>& pages, const QVector<quint32>& order);
+	static bool foldJournal(const QString& dir);
+};
+
+#endif // HOCRJOURNAL_HH
@@ -49,6 +49,8 @@ bool HOCROdtExporter::run(const HOCRDocument* hocrdocument, const QString& outna
 		QMessageBox::warning(MAIN, _("Export failed"), _("The ODT export failed: unable to write output file."));
 		return false;
 	}
+	// Item pointers are kept across pages while the export runs in the background
+	HOCRDocument::EvictionBlocker evictionBlocker(hocrdocument);
 	int pageCount = hocrdocument->pageCount();
 	MainWindow::ProgressMonitor monitor(2 * pageCount);
 	MAIN->showProgress(&monitor);
@@ -52,6 +52,7 @@
 bool HOCRPdfExporter::run(const HOCRDocument* hocrdocument, const QString& outname, const ExporterSettings* settings) {
 	const PDFSettings* pdfSettings = static_cast<const PDFSettings*> (settings);
 
+	HOCRDocument::EvictionBlocker evictionBlocker(hocrdocument);
 	int pageCount = hocrdocument->pageCount();
 	QString errMsg;
 	MainWindow::ProgressMonitor monitor(pageCount);
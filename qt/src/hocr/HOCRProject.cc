@@ -0,0 +1,479 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRProject.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QSet>
+
+#include <algorithm>
+#include <cstring>
+
+#include "HOCRDocument.hh"
+#include "HOCRProject.hh"
+#include "HOCRWordIndex.hh"
+
+// All records are stored in host byte order, files with a different byte order are rejected.
+// Records only hold 4 byte fields and all sections are 8 byte aligned, so that the records
+// can be accessed in place in the mapped file.
+
+static const char s_projectMagic[8] = {'G', 'I', 'R', 'H', 'O', 'C', 'R', '\0'};
+static constexpr quint32 s_projectByteOrder = 0x01020304;
+// Version 2: word counts are keyed by case folded rather than lower case words
+// Version 3: page blocks hold the number of low confidence words
+static constexpr quint32 s_projectVersion = 3;
+
+struct ProjectHeader {
+	char magic[8];
+	quint32 byteOrder;
+	quint32 version;
+};
+
+struct ProjectTrailer {
+	quint64 pageTableOffset;
+	quint64 stringTableOffset;
+	quint32 pageCount;
+	quint32 stringCount;
+	char magic[8];
+};
+
+// Followed by the item, attribute and word records of the page. The first item is the page itself,
+// the children of an item are stored consecutively after it.
+struct PageBlockHeader {
+	quint32 itemCount;
+	quint32 attrCount;
+	quint32 wordCount;
+	// Words with a confidence below 90, unused before version 3
+	quint32 lowConfidenceWords;
+};
+
+struct ItemRecord {
+	enum Flags : quint8 { Bold = 1, Italic = 2, Enabled = 4 };
+
+	quint32 firstChild;
+	quint32 childCount;
+	// The html attributes, followed by the title attributes
+	quint32 firstAttr;
+	quint16 attrCount;
+	quint16 titleAttrCount;
+	quint32 text;
+	qint32 bbox[4];
+	float baseline[2];
+	float fontSize;
+	float size;
+	qint32 wconf;
+	quint8 itemClass;
+	quint8 flags;
+	quint16 reserved;
+};
+
+struct AttrRecord {
+	quint32 name;
+	// The value of typed attributes is held in the item record
+	quint32 value;
+	quint32 typed;
+};
+
+struct WordRecord {
+	quint32 word;
+	quint32 count;
+};
+
+struct StringRecord {
+	quint64 offset;
+	// In UTF-16 code units
+	quint32 length;
+	quint32 reserved;
+};
+
+struct HOCRProject::PageData {
+	const ItemRecord* items;
+	const AttrRecord* attrs;
+	const WordRecord* words;
+	quint32 itemCount;
+	quint32 attrCount;
+	quint32 wordCount;
+	quint32 lowConfidenceWords;
+};
+
+static quint64 alignedSize(quint64 size) {
+	return (size + 7) & ~quint64(7);
+}
+
+
+QSharedPointer<HOCRProject> HOCRProject::open(const QString& filename) {
+	QSharedPointer<HOCRProject> project(new HOCRProject);
+	project->m_file.setFileName(filename);
+	if (!project->m_file.open(QIODevice::ReadOnly)) {
+		return QSharedPointer<HOCRProject>();
+	}
+	project->m_size = project->m_file.size();
+	project->m_data = project->m_file.map(0, project->m_size);
+	if (!project->m_data) {
+		project->m_buffer = project->m_file.readAll();
+		project->m_data = reinterpret_cast<const uchar*> (project->m_buffer.constData());
+		project->m_file.close();
+	}
+	if (!project->validate()) {
+		return QSharedPointer<HOCRProject>();
+	}
+	return project;
+}
+
+void HOCRProject::release() {
+	QWriteLocker locker(&m_dataLock);
+	if (!m_file.isOpen()) {
+		return;
+	}
+	m_buffer = QByteArray(reinterpret_cast<const char*> (m_data), m_size);
+	m_file.unmap(const_cast<uchar*> (m_data));
+	m_file.close();
+	m_data = reinterpret_cast<const uchar*> (m_buffer.constData());
+}
+
+bool HOCRProject::validate() {
+	if (m_size < qint64(sizeof(ProjectHeader) + sizeof(ProjectTrailer))) {
+		return false;
+	}
+	const ProjectHeader* header = reinterpret_cast<const ProjectHeader*> (m_data);
+	if (std::memcmp(header->magic, s_projectMagic, sizeof(s_projectMagic)) != 0 || header->byteOrder != s_projectByteOrder || header->version < 1 || header->version > s_projectVersion) {
+		return false;
+	}
+	m_version = header->version;
+	const ProjectTrailer* trailer = reinterpret_cast<const ProjectTrailer*> (m_data + m_size - sizeof(ProjectTrailer));
+	if (std::memcmp(trailer->magic, s_projectMagic, sizeof(s_projectMagic)) != 0) {
+		return false;
+	}
+	quint64 end = m_size - sizeof(ProjectTrailer);
+	if (trailer->pageTableOffset % 8 != 0 || trailer->pageTableOffset > end || quint64(trailer->pageCount) * sizeof(quint64) > end - trailer->pageTableOffset) {
+		return false;
+	}
+	if (trailer->stringTableOffset % 8 != 0 || trailer->stringTableOffset > end || quint64(trailer->stringCount) * sizeof(StringRecord) > end - trailer->stringTableOffset) {
+		return false;
+	}
+	m_pageCount = trailer->pageCount;
+	m_pageTableOffset = trailer->pageTableOffset;
+	m_stringCount = trailer->stringCount;
+	m_stringTableOffset = trailer->stringTableOffset;
+	// Only the bounds of the page blocks are checked upfront, the records are checked as they are read
+	PageData data;
+	for (quint32 page = 0; page < m_pageCount; ++page) {
+		if (!pageData(page, data)) {
+			return false;
+		}
+	}
+	m_strings.resize(m_stringCount);
+	return true;
+}
+
+bool HOCRProject::pageData(int page, PageData& data) const {
+	quint64 offset = reinterpret_cast<const quint64*> (m_data + m_pageTableOffset)[page];
+	quint64 end = m_size - sizeof(ProjectTrailer);
+	if (offset % 8 != 0 || offset > end || sizeof(PageBlockHeader) > end - offset) {
+		return false;
+	}
+	const PageBlockHeader* header = reinterpret_cast<const PageBlockHeader*> (m_data + offset);
+	quint64 size = sizeof(PageBlockHeader) + quint64(header->itemCount) * sizeof(ItemRecord) + quint64(header->attrCount) * sizeof(AttrRecord) + quint64(header->wordCount) * sizeof(WordRecord);
+	if (header->itemCount == 0 || size > end - offset) {
+		return false;
+	}
+	data.items = reinterpret_cast<const ItemRecord*> (m_data + offset + sizeof(PageBlockHeader));
+	data.attrs = reinterpret_cast<const AttrRecord*> (data.items + header->itemCount);
+	data.words = reinterpret_cast<const WordRecord*> (data.attrs + header->attrCount);
+	data.itemCount = header->itemCount;
+	data.attrCount = header->attrCount;
+	data.wordCount = header->wordCount;
+	data.lowConfidenceWords = header->lowConfidenceWords;
+	return true;
+}
+
+QString HOCRProject::string(quint32 id) const {
+	if (id == 0 || id >= m_stringCount) {
+		return QString();
+	}
+	QMutexLocker locker(&m_stringsMutex);
+	QString& string = m_strings[id];
+	if (string.isNull()) {
+		const StringRecord& record = reinterpret_cast<const StringRecord*> (m_data + m_stringTableOffset)[id];
+		if (record.offset % 2 == 0 && record.offset <= quint64(m_size) && quint64(record.length) * 2 <= m_size - record.offset) {
+			string = QString(reinterpret_cast<const QChar*> (m_data + record.offset), int (record.length));
+		}
+	}
+	return string;
+}
+
+void HOCRProject::readItem(const PageData& data, quint32 record, HOCRItem* item) const {
+	const ItemRecord& itemRecord = data.items[record];
+	quint64 attrCount = quint64(itemRecord.attrCount) + itemRecord.titleAttrCount;
+	if (itemRecord.firstAttr <= data.attrCount && attrCount <= data.attrCount - itemRecord.firstAttr) {
+		for (quint32 i = 0; i < attrCount; ++i) {
+			const AttrRecord& attrRecord = data.attrs[itemRecord.firstAttr + i];
+			HOCRItem::AttrEntry attr{HOCRItem::internKey(string(attrRecord.name)), attrRecord.typed != 0, attrRecord.typed ? QString() : string(attrRecord.value)};
+			(i < itemRecord.attrCount ? item->m_attrs : item->m_titleAttrs).append(attr);
+		}
+		// Keys which are not predefined may have been interned in a different order when the project was written
+		auto keyLess = [](const HOCRItem::AttrEntry& a, const HOCRItem::AttrEntry& b) { return a.key < b.key; };
+		if (!std::is_sorted(item->m_attrs.cbegin(), item->m_attrs.cend(), keyLess)) {
+			std::sort(item->m_attrs.begin(), item->m_attrs.end(), keyLess);
+		}
+		if (!std::is_sorted(item->m_titleAttrs.cbegin(), item->m_titleAttrs.cend(), keyLess)) {
+			std::sort(item->m_titleAttrs.begin(), item->m_titleAttrs.end(), keyLess);
+		}
+	}
+	item->m_itemClass = static_cast<HOCRItem::ItemClass> (itemRecord.itemClass <= quint8(HOCRItem::ItemClass::Separator) ? itemRecord.itemClass : 0);
+	item->m_text = string(itemRecord.text);
+	item->m_bold = itemRecord.flags & ItemRecord::Bold;
+	item->m_italic = itemRecord.flags & ItemRecord::Italic;
+	item->m_enabled = itemRecord.flags & ItemRecord::Enabled;
+	item->m_bbox.setCoords(itemRecord.bbox[0], itemRecord.bbox[1], itemRecord.bbox[2], itemRecord.bbox[3]);
+	item->m_baseline[0] = itemRecord.baseline[0];
+	item->m_baseline[1] = itemRecord.baseline[1];
+	item->m_fontSize = itemRecord.fontSize;
+	item->m_size = itemRecord.size;
+	item->m_wconf = itemRecord.wconf;
+	// As when parsing hOCR, the spelling of words is checked once they are displayed
+	item->m_misspelled = item->m_itemClass == HOCRItem::ItemClass::Word ? -1 : 0;
+	if (item->m_parentItem) {
+		item->assignId();
+	}
+}
+
+void HOCRProject::readChildren(const PageData& data, quint32 record, HOCRItem* parent) const {
+	const ItemRecord& itemRecord = data.items[record];
+	// Children are always stored after their parent, which also rules out cycles
+	if (itemRecord.firstChild <= record || itemRecord.firstChild > data.itemCount || itemRecord.childCount > data.itemCount - itemRecord.firstChild) {
+		return;
+	}
+	parent->m_childItems.reserve(itemRecord.childCount);
+	// Items are constructed in document order, so that they get the same ids as when parsing hOCR
+	for (quint32 i = 0; i < itemRecord.childCount; ++i) {
+		HOCRItem* item = new HOCRItem(parent->m_pageItem, parent, parent->m_childItems.size());
+		parent->m_childItems.append(item);
+		readItem(data, itemRecord.firstChild + i, item);
+		readChildren(data, itemRecord.firstChild + i, item);
+	}
+}
+
+int HOCRProject::lowConfidenceWords(const PageData& data) const {
+	if (m_version >= 3) {
+		return data.lowConfidenceWords;
+	}
+	// As HOCRItem::wordConfidence, words without a confidence have a confidence of 0
+	int count = 0;
+	for (quint32 record = 0; record < data.itemCount; ++record) {
+		const ItemRecord& itemRecord = data.items[record];
+		if (itemRecord.itemClass != quint8(HOCRItem::ItemClass::Word)) {
+			continue;
+		}
+		int wconf = 0;
+		quint64 firstTitleAttr = quint64(itemRecord.firstAttr) + itemRecord.attrCount;
+		if (firstTitleAttr <= data.attrCount && itemRecord.titleAttrCount <= data.attrCount - firstTitleAttr) {
+			for (quint32 i = 0; i < itemRecord.titleAttrCount; ++i) {
+				const AttrRecord& attrRecord = data.attrs[firstTitleAttr + i];
+				if (string(attrRecord.name) == QLatin1String("x_wconf")) {
+					wconf = attrRecord.typed ? itemRecord.wconf : string(attrRecord.value).toInt();
+					break;
+				}
+			}
+		}
+		count += wconf < 90;
+	}
+	return count;
+}
+
+void HOCRProject::readPage(int page, HOCRPage* pageItem) const {
+	QReadLocker locker(&m_dataLock);
+	PageData data;
+	if (!pageData(page, data)) {
+		return;
+	}
+	readItem(data, 0, pageItem);
+	const ItemRecord& itemRecord = data.items[0];
+	pageItem->m_childCount = itemRecord.firstChild > 0 && itemRecord.firstChild <= data.itemCount && itemRecord.childCount <= data.itemCount - itemRecord.firstChild ? itemRecord.childCount : 0;
+	pageItem->m_wordCounts.reserve(data.wordCount);
+	for (quint32 i = 0; i < data.wordCount; ++i) {
+		QString word = string(data.words[i].word);
+		if (m_version < 2) {
+			word = HOCRWordIndex::normalize(word);
+		}
+		if (!word.isEmpty()) {
+			pageItem->m_wordCounts[word] += data.words[i].count;
+		}
+	}
+	pageItem->m_lowConfidenceWords = lowConfidenceWords(data);
+}
+
+void HOCRProject::readPageWords(int page, QHash<QString, QStringList>& words) const {
+	words.clear();
+	QReadLocker locker(&m_dataLock);
+	PageData data;
+	if (!pageData(page, data)) {
+		return;
+	}
+	QHash<QString, QSet<QString>> spellingWords;
+	for (quint32 record = 0; record < data.itemCount; ++record) {
+		const ItemRecord& itemRecord = data.items[record];
+		if (itemRecord.itemClass != quint8(HOCRItem::ItemClass::Word)) {
+			continue;
+		}
+		QString trimmed = HOCRItem::trimmedWord(string(itemRecord.text));
+		if (trimmed.isEmpty()) {
+			continue;
+		}
+		// Word items hold their language, see HOCRItem::parseChildren
+		QString lang;
+		if (itemRecord.firstAttr <= data.attrCount && itemRecord.attrCount <= data.attrCount - itemRecord.firstAttr) {
+			for (quint32 i = 0; i < itemRecord.attrCount; ++i) {
+				const AttrRecord& attrRecord = data.attrs[itemRecord.firstAttr + i];
+				if (string(attrRecord.name) == QLatin1String("lang")) {
+					lang = string(attrRecord.value);
+					break;
+				}
+			}
+		}
+		spellingWords[lang].insert(trimmed);
+	}
+	for (auto it = spellingWords.begin(), itEnd = spellingWords.end(); it != itEnd; ++it) {
+		words.insert(it.key(), it.value().values());
+	}
+}
+
+void HOCRProject::readPageItems(int page, HOCRPage* pageItem) const {
+	QReadLocker locker(&m_dataLock);
+	PageData data;
+	if (pageData(page, data)) {
+		readChildren(data, 0, pageItem);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HOCRProjectWriter::HOCRProjectWriter(QIODevice* device) : m_device(device) {
+	// The empty string always has id 0
+	m_strings.append(QString());
+	ProjectHeader header;
+	std::memcpy(header.magic, s_projectMagic, sizeof(s_projectMagic));
+	header.byteOrder = s_projectByteOrder;
+	header.version = s_projectVersion;
+	writeData(&header, sizeof(header));
+	writePadding();
+}
+
+bool HOCRProjectWriter::writePage(const HOCRPage* page) {
+	QVector<ItemRecord> items(1);
+	QVector<AttrRecord> attrs;
+	QVector<const HOCRItem*> queue = {page};
+	quint32 lowConfidenceWords = 0;
+	// The items are numbered breadth first, so that the children of each item are consecutive
+	for (int i = 0; i < queue.size(); ++i) {
+		const HOCRItem* item = queue[i];
+		ItemRecord& record = items[i];
+		record.firstAttr = attrs.size();
+		record.attrCount = item->m_attrs.size();
+		record.titleAttrCount = item->m_titleAttrs.size();
+		for (const QVector<HOCRItem::AttrEntry>* group : {&item->m_attrs, &item->m_titleAttrs}) {
+			for (const HOCRItem::AttrEntry& attr : *group) {
+				attrs.append(AttrRecord{stringId(HOCRItem::keyName(attr.key)), attr.typed ? 0 : stringId(attr.value), attr.typed});
+			}
+		}
+		record.text = stringId(item->m_text);
+		record.bbox[0] = item->m_bbox.left();
+		record.bbox[1] = item->m_bbox.top();
+		record.bbox[2] = item->m_bbox.right();
+		record.bbox[3] = item->m_bbox.bottom();
+		record.baseline[0] = item->m_baseline[0];
+		record.baseline[1] = item->m_baseline[1];
+		record.fontSize = item->m_fontSize;
+		record.size = item->m_size;
+		record.wconf = item->m_wconf;
+		record.itemClass = quint8(item->m_itemClass);
+		lowConfidenceWords += item->m_itemClass == HOCRItem::ItemClass::Word && item->wordConfidence() < 90;
+		record.flags = (item->m_bold ? ItemRecord::Bold : 0) | (item->m_italic ? ItemRecord::Italic : 0) | (item->m_enabled ? ItemRecord::Enabled : 0);
+		const QVector<HOCRItem*>& children = item->children();
+		record.firstChild = items.size();
+		record.childCount = children.size();
+		items.resize(items.size() + children.size());
+		for (const HOCRItem* child : children) {
+			queue.append(child);
+		}
+	}
+	QVector<WordRecord> words;
+	words.reserve(page->m_wordCounts.size());
+	for (auto it = page->m_wordCounts.begin(), itEnd = page->m_wordCounts.end(); it != itEnd; ++it) {
+		words.append(WordRecord{stringId(it.key()), quint32(it.value())});
+	}
+
+	PageBlockHeader header = {quint32(items.size()), quint32(attrs.size()), quint32(words.size()), lowConfidenceWords};
+	m_pageOffsets.append(m_pos);
+	writeData(&header, sizeof(header));
+	writeData(items.constData(), items.size() * sizeof(ItemRecord));
+	writeData(attrs.constData(), attrs.size() * sizeof(AttrRecord));
+	writeData(words.constData(), words.size() * sizeof(WordRecord));
+	return writePadding();
+}
+
+bool HOCRProjectWriter::finish() {
+	ProjectTrailer trailer;
+	trailer.pageTableOffset = m_pos;
+	trailer.pageCount = m_pageOffsets.size();
+	writeData(m_pageOffsets.constData(), m_pageOffsets.size() * sizeof(quint64));
+	writePadding();
+
+	trailer.stringTableOffset = m_pos;
+	trailer.stringCount = m_strings.size();
+	quint64 offset = m_pos + m_strings.size() * sizeof(StringRecord);
+	QVector<StringRecord> records;
+	records.reserve(m_strings.size());
+	for (const QString& string : m_strings) {
+		records.append(StringRecord{offset, quint32(string.size()), 0});
+		offset += string.size() * sizeof(QChar);
+	}
+	writeData(records.constData(), records.size() * sizeof(StringRecord));
+	for (const QString& string : m_strings) {
+		writeData(string.constData(), string.size() * sizeof(QChar));
+	}
+	writePadding();
+
+	std::memcpy(trailer.magic, s_projectMagic, sizeof(s_projectMagic));
+	return writeData(&trailer, sizeof(trailer));
+}
+
+quint32 HOCRProjectWriter::stringId(const QString& string) {
+	if (string.isEmpty()) {
+		return 0;
+	}
+	auto it = m_stringIds.find(string);
+	if (it == m_stringIds.end()) {
+		it = m_stringIds.insert(string, m_strings.size());
+		m_strings.append(string);
+	}
+	return it.value();
+}
+
+bool HOCRProjectWriter::writeData(const void* data, qint64 size) {
+	if (m_ok && size > 0) {
+		m_ok = m_device->write(reinterpret_cast<const char*> (data), size) == size;
+		m_pos += size;
+	}
+	return m_ok;
+}
+
+bool HOCRProjectWriter::writePadding() {
+	static const char padding[8] = {};
+	return writeData(padding, alignedSize(m_pos) - m_pos);
+}
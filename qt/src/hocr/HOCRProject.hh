@@ -0,0 +1,118 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRProject.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOCRPROJECT_HH
+#define HOCRPROJECT_HH
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+class QIODevice;
+class HOCRItem;
+class HOCRPage;
+
+/**
+ * Binary hOCR project file. The file consists of one block per page holding
+ * fixed-width records of its items, their attributes and its word counts,
+ * followed by the page table and a pool of the strings referenced by the
+ * records. The file is memory-mapped, so opening it only reads the page
+ * table and the page items, while the items of the pages are constructed
+ * once they are accessed. The records hold the very state of the items, so
+ * converting between hOCR and projects is lossless.
+ */
+class HOCRProject {
+public:
+	// Returns a null pointer if the file cannot be read or is not a valid project
+	static QSharedPointer<HOCRProject> open(const QString& filename);
+
+	int pageCount() const {
+		return m_pageCount;
+	}
+	QString fileName() const {
+		return m_file.fileName();
+	}
+	// Copies the contents of the mapped file to memory and closes it, so that the file can be replaced
+	void release();
+
+private:
+	friend class HOCRPage;
+
+	struct PageData;
+
+	QFile m_file;
+	// Holds the file contents if the file cannot be mapped
+	QByteArray m_buffer;
+	const uchar* m_data = nullptr;
+	qint64 m_size = 0;
+	// Held for reading while the records are accessed, the data is replaced on release
+	mutable QReadWriteLock m_dataLock;
+	quint32 m_version = 0;
+	quint32 m_pageCount = 0;
+	quint64 m_pageTableOffset = 0;
+	quint32 m_stringCount = 0;
+	quint64 m_stringTableOffset = 0;
+	// Strings are decoded on first use, pages may be loaded from worker threads
+	mutable QMutex m_stringsMutex;
+	mutable QVector<QString> m_strings;
+
+	HOCRProject() = default;
+	bool validate();
+	bool pageData(int page, PageData& data) const;
+	QString string(quint32 id) const;
+	void readItem(const PageData& data, quint32 record, HOCRItem* item) const;
+	void readChildren(const PageData& data, quint32 record, HOCRItem* parent) const;
+	int lowConfidenceWords(const PageData& data) const;
+	// Restores the page item, its word counts and its low confidence count
+	void readPage(int page, HOCRPage* pageItem) const;
+	// Collects the distinct trimmed words of the page by language, without constructing its items
+	void readPageWords(int page, QHash<QString, QStringList>& words) const;
+	// Constructs the items of the page
+	void readPageItems(int page, HOCRPage* pageItem) const;
+};
+
+/**
+ * Writes pages to a binary hOCR project, see HOCRProject.
+ */
+class HOCRProjectWriter {
+public:
+	HOCRProjectWriter(QIODevice* device);
+
+	bool writePage(const HOCRPage* page);
+	// Writes the page table and the string pool
+	bool finish();
+
+private:
+	QIODevice* m_device;
+	qint64 m_pos = 0;
+	bool m_ok = true;
+	QVector<quint64> m_pageOffsets;
+	QHash<QString, quint32> m_stringIds;
+	QVector<QString> m_strings;
+
+	quint32 stringId(const QString& string);
+	bool writeData(const void* data, qint64 size);
+	bool writePadding();
+};
+
+#endif // HOCRPROJECT_HH
@@ -37,38 +37,62 @@
 
 class HOCRProofReadWidget::LineEdit : public QLineEdit {
 public:
-	LineEdit(HOCRProofReadWidget* proofReadWidget, HOCRItem* wordItem, QWidget* parent = nullptr) :
-		QLineEdit(wordItem->text(), parent), m_proofReadWidget(proofReadWidget), m_wordItem(wordItem) {
+	LineEdit(HOCRProofReadWidget* proofReadWidget, QWidget* parent = nullptr) :
+		QLineEdit(parent), m_proofReadWidget(proofReadWidget), m_baseFont(font()) {
 		connect(this, &LineEdit::textChanged, this, &LineEdit::onTextChanged);
 
 		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
 		connect(document, &HOCRDocument::dataChanged, this, &LineEdit::onModelDataChanged);
 		connect(document, &HOCRDocument::itemAttributeChanged, this, &LineEdit::onAttributeChanged);
-
-		QModelIndex index = document->indexAtItem(m_wordItem);
-		setStyleSheet(getStyle(document->indexIsMisspelledWord(index)));
-
-		QFont ft = font();
-		ft.setBold(m_wordItem->fontBold());
-		ft.setItalic(m_wordItem->fontItalic());
-		setFont(ft);
 	}
 	const HOCRItem* item() const { return m_wordItem; }
 
+	// Line edits are recycled, binding them to another word rather than recreating them
+	void bind(HOCRItem* wordItem) {
+		m_wordItem = wordItem;
+		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
+		{
+			QSignalBlocker blocker(this);
+			setText(m_wordItem->text());
+		}
+		setMisspelled(document->indexIsMisspelledWord(document->indexAtItem(m_wordItem)));
+		updateFont();
+	}
+	void unbind() {
+		m_wordItem = nullptr;
+	}
+	void setBaseFont(const QFont& font) {
+		m_baseFont = font;
+		updateFont();
+	}
+
 private:
 	HOCRProofReadWidget* m_proofReadWidget = nullptr;
 	HOCRItem* m_wordItem = nullptr;
+	QFont m_baseFont;
 	bool m_blockSetText = false;
+	bool m_misspelled = false;
 
-	QString getStyle(bool misspelled) const {
-		QStringList styles;
-		if (misspelled) {
-			styles.append("color: red;");
+	// Setting the font or the style sheet re-polishes the widget, so skip it if nothing changed
+	void updateFont() {
+		QFont ft = m_baseFont;
+		ft.setBold(m_wordItem->fontBold());
+		ft.setItalic(m_wordItem->fontItalic());
+		if (ft != font()) {
+			setFont(ft);
+		}
+	}
+	void setMisspelled(bool misspelled) {
+		if (misspelled != m_misspelled) {
+			m_misspelled = misspelled;
+			setStyleSheet(misspelled ? "QLineEdit {color: red;}" : "");
 		}
-		return styles.isEmpty() ? "" : QString("QLineEdit {%1}").arg(styles.join(" "));
 	}
 
 	void onTextChanged() {
+		if (!m_wordItem) {
+			return;
+		}
 		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
 
 		// Update data in document
@@ -78,6 +102,9 @@ private:
 		m_blockSetText = false;
 	}
 	void onModelDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles) {
+		if (!m_wordItem) {
+			return;
+		}
 		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
 		QItemSelectionRange range(topLeft, bottomRight);
 		QModelIndex index = document->indexAtItem(m_wordItem);
@@ -86,18 +113,15 @@ private:
 				setText(m_wordItem->text());
 			}
 			if (roles.contains(Qt::ForegroundRole)) {
-				setStyleSheet(getStyle(document->indexIsMisspelledWord(index)));
+				setMisspelled(document->indexIsMisspelledWord(index));
 			}
 		}
 	}
 	void onAttributeChanged(const QModelIndex& index, const QString& name, const QString& /*value*/) {
 		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
-		if (document->itemAtIndex(index) == m_wordItem) {
+		if (m_wordItem && document->itemAtIndex(index) == m_wordItem) {
 			if (name == "bold" || name == "italic") {
-				QFont ft = font();
-				ft.setBold(m_wordItem->fontBold());
-				ft.setItalic(m_wordItem->fontItalic());
-				setFont(ft);
+				updateFont();
 			} else if (name == "title:bbox") {
 				QPoint sceneCorner = MAIN->getDisplayer()->getSceneBoundingRect().toRect().topLeft();
 				QRect sceneBBox = m_wordItem->bbox().translated(sceneCorner);
@@ -203,7 +227,7 @@ private:
 	void focusInEvent(QFocusEvent* ev) override {
 		HOCRDocument* document = static_cast<HOCRDocument*> (m_proofReadWidget->documentTree()->model());
 		m_proofReadWidget->documentTree()->setCurrentIndex(document->indexAtItem(m_wordItem));
-		m_proofReadWidget->setConfidenceLabel(m_wordItem->getTitleAttributes() ["x_wconf"].toInt());
+		m_proofReadWidget->setConfidenceLabel(m_wordItem->wordConfidence());
 		QLineEdit::focusInEvent(ev);
 		if (ev->reason() != Qt::MouseFocusReason) {
 			deselect();
@@ -213,6 +237,41 @@ private:
 };
 
 
+class HOCRProofReadWidget::LineWidget : public QWidget {
+public:
+	LineWidget(HOCRProofReadWidget* proofReadWidget) : m_proofReadWidget(proofReadWidget) {}
+
+	// Binds the line edits to the words of the line, creating more line edits if needed
+	void bind(const HOCRItem* lineItem) {
+		const QVector<HOCRItem*>& words = lineItem->children();
+		while (m_lineEdits.size() < words.size()) {
+			m_lineEdits.append(new LineEdit(m_proofReadWidget, this));
+		}
+		for (int i = 0, n = words.size(); i < n; ++i) {
+			m_lineEdits[i]->bind(words[i]);
+			m_lineEdits[i]->show();
+		}
+		for (int i = words.size(), n = m_count; i < n; ++i) {
+			m_lineEdits[i]->unbind();
+			m_lineEdits[i]->hide();
+		}
+		m_count = words.size();
+	}
+	void unbind() {
+		for (int i = 0; i < m_count; ++i) {
+			m_lineEdits[i]->unbind();
+		}
+	}
+	int lineEditCount() const { return m_count; }
+	LineEdit* lineEdit(int i) const { return m_lineEdits[i]; }
+
+private:
+	HOCRProofReadWidget* m_proofReadWidget = nullptr;
+	QVector<LineEdit*> m_lineEdits;
+	int m_count = 0;
+};
+
+
 HOCRProofReadWidget::HOCRProofReadWidget(QTreeView* treeView, QWidget* parent)
 	: QFrame(parent), m_treeView(treeView) {
 	QVBoxLayout* layout = new QVBoxLayout;
@@ -324,7 +383,9 @@ void HOCRProofReadWidget::setProofreadEnabled(bool enabled) {
 }
 
 void HOCRProofReadWidget::clear() {
-	qDeleteAll(m_currentLines);
+	for (LineWidget* lineWidget : m_currentLines) {
+		recycleLineWidget(lineWidget);
+	}
 	m_currentLines.clear();
 	m_currentLine = nullptr;
 	m_confidenceLabel->setText("");
@@ -363,7 +424,7 @@ void HOCRProofReadWidget::updateWidget(bool force) {
 	const QVector<HOCRItem*>& siblings = lineItem->parent()->children();
 	if (lineItem != m_currentLine || force) {
 		// Rebuild widget
-		QMap<const HOCRItem*, QWidget*> newLines;
+		QMap<const HOCRItem*, LineWidget*> newLines;
 		int insPos = 0;
 		int targetLine = lineItem->index();
 		for (int i = qMax(0, targetLine - nrLinesBefore), j = qMin(siblings.size() - 1, targetLine + nrLinesAfter); i <= j; ++i) {
@@ -372,24 +433,21 @@ void HOCRProofReadWidget::updateWidget(bool force) {
 				newLines[linei] = m_currentLines.take(linei);
 				insPos = m_linesLayout->indexOf(newLines[linei]) + 1;
 			} else {
-				QWidget* lineWidget = new QWidget();
-				for (HOCRItem* word : siblings[i]->children()) {
-					new LineEdit(this, word, lineWidget);  // Add as child to lineWidget
-				}
-				m_linesLayout->insertWidget(insPos++, lineWidget);
-				newLines.insert(linei, lineWidget);
+				newLines.insert(linei, takeLineWidget(insPos++, linei));
 			}
 		}
-		qDeleteAll(m_currentLines);
+		for (LineWidget* lineWidget : m_currentLines) {
+			recycleLineWidget(lineWidget);
+		}
 		m_currentLines = newLines;
 		m_currentLine = lineItem;
 		repositionWidget();
 	}
 
 	// Select selected word or first item of middle line
-	QObjectList lineChildren = m_currentLines[lineItem]->children();
-	if (!lineChildren.empty()) {
-		LineEdit* focusLineEdit = static_cast<LineEdit*>(lineChildren[wordItem ? wordItem->index() : 0]);
+	LineWidget* currentLineWidget = m_currentLines[lineItem];
+	if (currentLineWidget->lineEditCount() > 0) {
+		LineEdit* focusLineEdit = currentLineWidget->lineEdit(wordItem ? wordItem->index() : 0);
 		if (focusLineEdit && !m_treeView->hasFocus()) {
 			focusLineEdit->setFocus();
 		}
@@ -397,6 +455,44 @@ void HOCRProofReadWidget::updateWidget(bool force) {
 
 }
 
+HOCRProofReadWidget::LineWidget* HOCRProofReadWidget::takeLineWidget(int pos, const HOCRItem* lineItem) {
+	LineWidget* lineWidget = nullptr;
+	if (!m_linePool.isEmpty()) {
+		lineWidget = m_linePool.takeLast();
+	} else {
+		lineWidget = new LineWidget(this);
+	}
+	lineWidget->bind(lineItem);
+	m_linesLayout->insertWidget(pos, lineWidget);
+	lineWidget->show();
+	return lineWidget;
+}
+
+void HOCRProofReadWidget::recycleLineWidget(LineWidget* lineWidget) {
+	// The widget stays a child of the lines widget, it is only taken out of the layout
+	m_linesLayout->removeWidget(lineWidget);
+	lineWidget->hide();
+	lineWidget->unbind();
+	m_linePool.append(lineWidget);
+}
+
+HOCRProofReadWidget::CachedFont HOCRProofReadWidget::cachedFont(double pointSize) {
+	// Sizes are quantized to quarter points, so that zooming doesn't flood the cache
+	QFont ft = font();
+	QPair<QString, int> key(ft.family(), qMax(4, qRound(pointSize * 4)));
+	auto it = m_fontCache.constFind(key);
+	if (it != m_fontCache.constEnd()) {
+		return it.value();
+	}
+	if (m_fontCache.size() >= s_fontCacheSize) {
+		m_fontCache.clear();
+	}
+	ft.setPointSizeF(key.second / 4.);
+	CachedFont cached{ft, QFontMetrics(ft)};
+	m_fontCache.insert(key, cached);
+	return cached;
+}
+
 void HOCRProofReadWidget::repositionWidget() {
 
 	if (m_currentLines.isEmpty() || !m_enabled) {
@@ -408,12 +504,12 @@ void HOCRProofReadWidget::repositionWidget() {
 	int frameXmin = std::numeric_limits<int>::max();
 	int frameXmax = 0;
 	QPoint sceneCorner = displayer->getSceneBoundingRect().toRect().topLeft();
-	for (QWidget* lineWidget : m_currentLines) {
-		if (lineWidget->children().isEmpty()) {
+	for (LineWidget* lineWidget : m_currentLines) {
+		if (lineWidget->lineEditCount() == 0) {
 			continue;
 		}
 		// First word
-		LineEdit* lineEdit = static_cast<LineEdit*> (lineWidget->children() [0]);
+		LineEdit* lineEdit = lineWidget->lineEdit(0);
 		QPoint bottomLeft = displayer->mapFromScene(lineEdit->item()->bbox().translated(sceneCorner).bottomLeft());
 		frameXmin = std::min(frameXmin, bottomLeft.x());
 	}
@@ -422,14 +518,13 @@ void HOCRProofReadWidget::repositionWidget() {
 	int frameY = bottomLeftTmp.y();
 
 	// Recompute font sizes so that text matches original as closely as possible
-	QFont ft = font();
-	QFontMetrics fm(ft);
+	QFontMetrics fm = cachedFont(font().pointSizeF()).metrics;
 	double avgFactor = 0.0;
 	int nFactors = 0;
 	// First pass: min scaling factor, move to correct location
-	for (QWidget* lineWidget : m_currentLines) {
-		for (int i = 0, n = lineWidget->children().count(); i < n; ++i) {
-			LineEdit* lineEdit = static_cast<LineEdit*> (lineWidget->children() [i]);
+	for (LineWidget* lineWidget : m_currentLines) {
+		for (int i = 0, n = lineWidget->lineEditCount(); i < n; ++i) {
+			LineEdit* lineEdit = lineWidget->lineEdit(i);
 			QRect sceneBBox = lineEdit->item()->bbox().translated(sceneCorner);
 			QPoint bottomLeft = displayer->mapFromScene(sceneBBox.bottomLeft());
 			QPoint bottomRight = displayer->mapFromScene(sceneBBox.bottomRight());
@@ -445,14 +540,13 @@ void HOCRProofReadWidget::repositionWidget() {
 	avgFactor = avgFactor > 0 ? avgFactor / nFactors : 1.;
 
 	// Second pass: apply font sizes, set line heights
-	ft.setPointSizeF(ft.pointSizeF() * avgFactor);
-	fm = QFontMetrics(ft);
-	for (QWidget* lineWidget : m_currentLines) {
-		for (int i = 0, n = lineWidget->children().count(); i < n; ++i) {
-			LineEdit* lineEdit = static_cast<LineEdit*> (lineWidget->children() [i]);
-			QFont lineEditFont = lineEdit->font();
-			lineEditFont.setPointSizeF(ft.pointSizeF() + m_fontSizeDiff);
-			lineEdit->setFont(lineEditFont);
+	CachedFont scaled = cachedFont(font().pointSizeF() * avgFactor);
+	fm = scaled.metrics;
+	QFont lineEditFont = cachedFont(scaled.font.pointSizeF() + m_fontSizeDiff).font;
+	for (LineWidget* lineWidget : m_currentLines) {
+		for (int i = 0, n = lineWidget->lineEditCount(); i < n; ++i) {
+			LineEdit* lineEdit = lineWidget->lineEdit(i);
+			lineEdit->setBaseFont(lineEditFont);
 			lineEdit->setFixedHeight(fm.height() + 5);
 		}
 		lineWidget->setFixedHeight(fm.height() + 10);
@@ -20,8 +20,12 @@
 #ifndef HOCRPROOFREADWIDGET_HH
 #define HOCRPROOFREADWIDGET_HH
 
+#include <QFont>
+#include <QFontMetrics>
+#include <QHash>
 #include <QMap>
 #include <QFrame>
+#include <QVector>
 
 class QLabel;
 class QSpinBox;
@@ -42,13 +46,24 @@ public:
 
 private:
 	class LineEdit;
+	class LineWidget;
+
+	struct CachedFont {
+		QFont font;
+		QFontMetrics metrics;
+	};
+	static constexpr int s_fontCacheSize = 64;
 
 	QTreeView* m_treeView = nullptr;
 	QVBoxLayout* m_linesLayout = nullptr;
 	const HOCRItem* m_currentLine = nullptr;
 	QWidget* m_controlsWidget = nullptr;
 	QLabel* m_confidenceLabel = nullptr;
-	QMap<const HOCRItem*, QWidget*> m_currentLines;
+	QMap<const HOCRItem*, LineWidget*> m_currentLines;
+	// Line widgets which are not shown, kept for reuse
+	QVector<LineWidget*> m_linePool;
+	// Fonts and their metrics by family and size
+	QHash<QPair<QString, int>, CachedFont> m_fontCache;
 	QSpinBox* m_spinLinesBefore = nullptr;
 	QSpinBox* m_spinLinesAfter = nullptr;
 	int m_fontSizeDiff = 0;
@@ -58,6 +73,9 @@ private:
 	bool focusNextPrevChild(bool) override { return false; }
 
 	void repositionWidget();
+	LineWidget* takeLineWidget(int pos, const HOCRItem* lineItem);
+	void recycleLineWidget(LineWidget* lineWidget);
+	CachedFont cachedFont(double pointSize);
 
 private slots:
 	void updateWidget(bool force = false);
@@ -0,0 +1,332 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRReader.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QIODevice>
+#include <QXmlStreamWriter>
+
+#include <cstring>
+
+#include "HOCRReader.hh"
+
+
+HOCRReader::HOCRReader(QIODevice* device)
+	: m_device(device), m_reader(device) {
+	// Like QDomDocument::setContent, treat namespace declarations and prefixes as plain names
+	m_reader.setNamespaceProcessing(false);
+}
+
+QDomElement HOCRReader::readNextPage() {
+	return readPage(nullptr);
+}
+
+QDomElement HOCRReader::readNextPage(QByteArray& pageXml, int& childCount, HOCRPageWords& words) {
+	PageData data = {pageXml, childCount, words};
+	return readPage(&data);
+}
+
+QDomElement HOCRReader::readPage(PageData* data) {
+	// Release the previous page
+	m_pageDoc = QDomDocument();
+	// Pages are the div children of the (first) body
+	while (!m_invalid && !m_bodyRead && !m_reader.atEnd()) {
+		QXmlStreamReader::TokenType token = m_reader.readNext();
+		if (token == QXmlStreamReader::StartElement) {
+			QString name = m_reader.qualifiedName().toString();
+			++m_depth;
+			if (m_depth == 1 && name != "html") {
+				m_invalid = true;
+			} else if (m_depth == 2 && name == "body") {
+				m_inBody = true;
+			} else if (m_depth == 3 && m_inBody && name == "div") {
+				QDomElement page = data ? readElementShallow(*data) : readElement();
+				--m_depth;
+				if (m_reader.hasError()) {
+					break;
+				}
+				if (m_pageCount++ == 0 && page.attribute("class") != "ocr_page") {
+					m_invalid = true;
+					break;
+				}
+				return page;
+			}
+		} else if (token == QXmlStreamReader::EndElement) {
+			--m_depth;
+			if (m_depth == 1 && m_inBody) {
+				m_inBody = false;
+				m_bodyRead = true;
+			}
+		}
+	}
+	if (!m_reader.hasError() && m_pageCount == 0) {
+		// No pages at all
+		m_invalid = true;
+	}
+	return QDomElement();
+}
+
+QDomElement HOCRReader::readPageFragment(QByteArray& pageXml, int& childCount, HOCRPageWords& words) {
+	m_pageDoc = QDomDocument();
+	while (!m_reader.atEnd()) {
+		if (m_reader.readNext() == QXmlStreamReader::StartElement) {
+			PageData data = {pageXml, childCount, words};
+			QDomElement page = readElementShallow(data);
+			return m_reader.hasError() ? QDomElement() : page;
+		}
+	}
+	return QDomElement();
+}
+
+static const char* findSequence(const char* pos, const char* end, const char* sequence) {
+	std::size_t length = std::strlen(sequence);
+	for (; pos + length <= end; ++pos) {
+		pos = static_cast<const char*> (std::memchr(pos, sequence[0], end - pos));
+		if (!pos || pos + length > end) {
+			return nullptr;
+		}
+		if (std::memcmp(pos, sequence, length) == 0) {
+			return pos;
+		}
+	}
+	return nullptr;
+}
+
+bool HOCRReader::splitPages(const QByteArray& data, QVector<QPair<int, int>>& pages) {
+	const char* begin = data.constData();
+	const char* end = begin + data.size();
+	// Page fragments are read without the XML declaration, hence as UTF-8
+	if (data.startsWith("\xFE\xFF") || data.startsWith("\xFF\xFE")) {
+		return false;
+	}
+	if (data.startsWith("<?xml")) {
+		QByteArray declaration = data.left(data.indexOf("?>")).toLower();
+		if (declaration.contains("encoding") && !declaration.contains("utf-8")) {
+			return false;
+		}
+	}
+	// Same structure as read by readPage: the pages are the div children of the first body
+	int depth = 0;
+	bool inBody = false;
+	const char* pageStart = nullptr;
+	const char* pos = begin;
+	while ((pos = static_cast<const char*> (std::memchr(pos, '<', end - pos)))) {
+		if (end - pos < 2) {
+			return false;
+		}
+		const char* next = nullptr;
+		if (pos[1] == '!' && end - pos >= 4 && std::memcmp(pos, "<!--", 4) == 0) {
+			next = findSequence(pos + 4, end, "-->");
+			next = next ? next + 3 : nullptr;
+		} else if (pos[1] == '!' && end - pos >= 9 && std::memcmp(pos, "<![CDATA[", 9) == 0) {
+			next = findSequence(pos + 9, end, "]]>");
+			next = next ? next + 3 : nullptr;
+		} else if (pos[1] == '?') {
+			next = findSequence(pos + 2, end, "?>");
+			next = next ? next + 2 : nullptr;
+		} else if (pos[1] == '!') {
+			// Doctype, documents with an internal subset are not split
+			next = static_cast<const char*> (std::memchr(pos, '>', end - pos));
+			if (next && std::memchr(pos, '[', next - pos)) {
+				return false;
+			}
+			next = next ? next + 1 : nullptr;
+		} else if (pos[1] == '/') {
+			next = static_cast<const char*> (std::memchr(pos, '>', end - pos));
+			if (!next || --depth < 0) {
+				return false;
+			}
+			++next;
+			if (depth == 2 && pageStart) {
+				pages.append(qMakePair(int (pageStart - begin), int (next - begin)));
+				pageStart = nullptr;
+			} else if (depth == 1 && inBody) {
+				return true;
+			}
+		} else {
+			// Start tag, '>' may appear in quoted attribute values
+			const char* tagEnd = pos + 1;
+			char quote = 0;
+			for (; tagEnd < end; ++tagEnd) {
+				if (quote) {
+					quote = *tagEnd == quote ? 0 : quote;
+				} else if (*tagEnd == '"' || *tagEnd == '\'') {
+					quote = *tagEnd;
+				} else if (*tagEnd == '>') {
+					break;
+				}
+			}
+			if (tagEnd == end) {
+				return false;
+			}
+			const char* nameEnd = pos + 1;
+			while (nameEnd < tagEnd && !std::strchr(" \t\r\n/", *nameEnd)) {
+				++nameEnd;
+			}
+			QByteArray name = QByteArray::fromRawData(pos + 1, nameEnd - pos - 1);
+			next = tagEnd + 1;
+			if (tagEnd[-1] == '/') {
+				if (depth == 2 && inBody && name == "div") {
+					pages.append(qMakePair(int (pos - begin), int (next - begin)));
+				}
+			} else {
+				++depth;
+				if (depth == 1 && name != "html") {
+					return false;
+				} else if (depth == 2 && name == "body") {
+					inBody = true;
+				} else if (depth == 3 && inBody && name == "div") {
+					pageStart = pos;
+				}
+			}
+		}
+		if (!next) {
+			return false;
+		}
+		pos = next;
+	}
+	// The body was not closed
+	return false;
+}
+
+qint64 HOCRReader::bytesRead() const {
+	return m_device->pos();
+}
+
+QDomElement HOCRReader::readElement() {
+	QDomElement root = createElement();
+	m_pageDoc.appendChild(root);
+	QDomElement current = root;
+	int depth = 1;
+	while (depth > 0 && !m_reader.atEnd()) {
+		switch (m_reader.readNext()) {
+		case QXmlStreamReader::StartElement: {
+			QDomElement element = createElement();
+			current.appendChild(element);
+			current = element;
+			++depth;
+			break;
+		}
+		case QXmlStreamReader::EndElement:
+			current = current.parentNode().toElement();
+			--depth;
+			break;
+		case QXmlStreamReader::Characters:
+			// QDomDocument drops whitespace-only text nodes as well
+			if (!m_reader.isWhitespace()) {
+				current.appendChild(m_pageDoc.createTextNode(m_reader.text().toString()));
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return root;
+}
+
+QDomElement HOCRReader::readElementShallow(PageData& data) {
+	QDomElement root = createElement();
+	m_pageDoc.appendChild(root);
+	data.xml.clear();
+	data.childCount = 0;
+	data.words.clear();
+	QXmlStreamWriter writer(&data.xml);
+	writeStartElement(writer);
+	int depth = 1;
+	// Depth of the word element currently being read, if any
+	int wordDepth = 0;
+	QString wordText;
+	// The lang attributes of the open elements below the page, as inherited when the items are parsed
+	QStringList langs = {QString()};
+	while (depth > 0 && !m_reader.atEnd()) {
+		switch (m_reader.readNext()) {
+		case QXmlStreamReader::StartElement: {
+			// Matches the children considered by HOCRPage: the first div and all following elements
+			if (depth == 1 && (data.childCount > 0 || m_reader.qualifiedName() == QLatin1String("div"))) {
+				++data.childCount;
+			}
+			writeStartElement(writer);
+			++depth;
+			const QXmlStreamAttributes attributes = m_reader.attributes();
+			QStringView lang = attributes.value(QLatin1String("lang"));
+			langs.append(lang.isEmpty() ? langs.last() : lang.toString());
+			if (wordDepth == 0 && attributes.value(QLatin1String("class")) == QLatin1String("ocrx_word")) {
+				wordDepth = depth;
+				wordText.clear();
+				data.words.lowConfidence += wordConfidence(attributes.value(QLatin1String("title"))) < 90;
+			}
+			break;
+		}
+		case QXmlStreamReader::EndElement:
+			writer.writeEndElement();
+			if (depth == wordDepth) {
+				data.words.texts.append(wordText);
+				data.words.langs.append(langs.last());
+				wordDepth = 0;
+			}
+			langs.removeLast();
+			--depth;
+			break;
+		case QXmlStreamReader::Characters:
+			if (!m_reader.isWhitespace()) {
+				QString text = m_reader.text().toString();
+				writer.writeCharacters(text);
+				if (wordDepth > 0) {
+					wordText += text;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return root;
+}
+
+int HOCRReader::wordConfidence(QStringView title) {
+	// As HOCRItem::wordConfidence, words without a confidence have a confidence of 0
+	int pos = title.indexOf(QLatin1String("x_wconf"));
+	if (pos < 0) {
+		return 0;
+	}
+	pos += 7;
+	while (pos < title.size() && title[pos].isSpace()) {
+		++pos;
+	}
+	int end = pos;
+	while (end < title.size() && !title[end].isSpace() && title[end] != ';') {
+		++end;
+	}
+	return title.mid(pos, end - pos).toString().toInt();
+}
+
+QDomElement HOCRReader::createElement() {
+	QDomElement element = m_pageDoc.createElement(m_reader.qualifiedName().toString());
+	const QXmlStreamAttributes attributes = m_reader.attributes();
+	for (const QXmlStreamAttribute& attribute : attributes) {
+		element.setAttribute(attribute.qualifiedName().toString(), attribute.value().toString());
+	}
+	return element;
+}
+
+void HOCRReader::writeStartElement(QXmlStreamWriter& writer) const {
+	writer.writeStartElement(m_reader.qualifiedName().toString());
+	const QXmlStreamAttributes attributes = m_reader.attributes();
+	for (const QXmlStreamAttribute& attribute : attributes) {
+		writer.writeAttribute(attribute.qualifiedName().toString(), attribute.value().toString());
+	}
+}
@@ -0,0 +1,97 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRReader.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOCRREADER_HH
+#define HOCRREADER_HH
+
+#include <QDomDocument>
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+#include <QXmlStreamReader>
+
+class QIODevice;
+class QXmlStreamWriter;
+
+// The words of a page as collected while reading it shallowly, see HOCRReader
+struct HOCRPageWords {
+	QStringList texts;
+	// The lang attribute of the closest element below the page div, if any, for each word
+	QStringList langs;
+	// Words with a confidence below 90
+	int lowConfidence = 0;
+
+	void clear() {
+		texts.clear();
+		langs.clear();
+		lowConfidence = 0;
+	}
+};
+
+/**
+ * Streaming reader for hOCR HTML files: pages are read one at a time, so that
+ * only the DOM of the current page needs to be held in memory.
+ */
+class HOCRReader {
+public:
+	HOCRReader(QIODevice* device);
+
+	// Returns the next page div of the document body, or a null element once all pages were read or on error
+	QDomElement readNextPage();
+	// Like readNextPage, but the returned element only holds the attributes of the page div. The complete
+	// page is serialized to pageXml, childCount is set to the number of its child elements and words to
+	// the words of the page.
+	QDomElement readNextPage(QByteArray& pageXml, int& childCount, HOCRPageWords& words);
+	// Like readNextPage, for a device holding a single page div as located by splitPages
+	QDomElement readPageFragment(QByteArray& pageXml, int& childCount, HOCRPageWords& words);
+	// Whether the document is malformed or not a hOCR document
+	bool hasError() const {
+		return m_invalid || m_reader.hasError();
+	}
+	qint64 bytesRead() const;
+
+	// Locates the page divs of a document without parsing it, so that the pages can be read independently.
+	// Returns false if the document cannot be split, i.e. because it is not UTF-8 encoded or malformed.
+	static bool splitPages(const QByteArray& data, QVector<QPair<int, int>>& pages);
+
+private:
+	QIODevice* m_device;
+	QXmlStreamReader m_reader;
+	QDomDocument m_pageDoc;
+	int m_depth = 0;
+	int m_pageCount = 0;
+	bool m_inBody = false;
+	bool m_bodyRead = false;
+	bool m_invalid = false;
+
+	struct PageData {
+		QByteArray& xml;
+		int& childCount;
+		HOCRPageWords& words;
+	};
+
+	QDomElement readPage(PageData* data);
+	QDomElement readElement();
+	QDomElement readElementShallow(PageData& data);
+	QDomElement createElement();
+	static int wordConfidence(QStringView title);
+	void writeStartElement(QXmlStreamWriter& writer) const;
+};
+
+#endif // HOCRREADER_HH
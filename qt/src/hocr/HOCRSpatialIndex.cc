@@ -0,0 +1,132 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRSpatialIndex.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QSet>
+#include <algorithm>
+
+#include "HOCRDocument.hh"
+#include "HOCRSpatialIndex.hh"
+
+
+void HOCRSpatialIndex::build(const HOCRPage* page) {
+	clear();
+	m_bounds = page->bbox().normalized();
+	if (m_bounds.isEmpty()) {
+		m_bounds = QRect(0, 0, 1, 1);
+	}
+	m_cellWidth = std::max(1, (m_bounds.width() + s_gridSize - 1) / s_gridSize);
+	m_cellHeight = std::max(1, (m_bounds.height() + s_gridSize - 1) / s_gridSize);
+	m_cols = (m_bounds.width() + m_cellWidth - 1) / m_cellWidth;
+	m_rows = (m_bounds.height() + m_cellHeight - 1) / m_cellHeight;
+	m_cells.resize(m_cols * m_rows);
+	m_built = true;
+	for (const HOCRItem* child : page->children()) {
+		insert(child);
+	}
+}
+
+void HOCRSpatialIndex::clear() {
+	m_built = false;
+	m_cells.clear();
+	m_itemRects.clear();
+}
+
+void HOCRSpatialIndex::insert(const HOCRItem* item) {
+	if (!m_built) {
+		return;
+	}
+	insertItem(item);
+	for (const HOCRItem* child : item->children()) {
+		insert(child);
+	}
+}
+
+void HOCRSpatialIndex::remove(const HOCRItem* item) {
+	if (!m_built) {
+		return;
+	}
+	removeItem(item);
+	for (const HOCRItem* child : item->children()) {
+		remove(child);
+	}
+}
+
+void HOCRSpatialIndex::update(const HOCRItem* item) {
+	if (m_itemRects.contains(item)) {
+		removeItem(item);
+		insertItem(item);
+	}
+}
+
+QVector<const HOCRItem*> HOCRSpatialIndex::query(const QRect& rect) const {
+	QVector<const HOCRItem*> items;
+	if (!m_built) {
+		return items;
+	}
+	QRect queryRect = rect.normalized();
+	int col0, row0, col1, row1;
+	cellRange(queryRect, col0, row0, col1, row1);
+	QSet<const HOCRItem*> seen;
+	for (int row = row0; row <= row1; ++row) {
+		for (int col = col0; col <= col1; ++col) {
+			for (const HOCRItem* item : m_cells[row * m_cols + col]) {
+				if (m_itemRects.value(item).intersects(queryRect) && !seen.contains(item)) {
+					seen.insert(item);
+					items.append(item);
+				}
+			}
+		}
+	}
+	return items;
+}
+
+void HOCRSpatialIndex::cellRange(const QRect& rect, int& col0, int& row0, int& col1, int& row1) const {
+	// Items outside of the page bounds end up in the border cells
+	col0 = qBound(0, (rect.left() - m_bounds.left()) / m_cellWidth, m_cols - 1);
+	col1 = qBound(0, (rect.right() - m_bounds.left()) / m_cellWidth, m_cols - 1);
+	row0 = qBound(0, (rect.top() - m_bounds.top()) / m_cellHeight, m_rows - 1);
+	row1 = qBound(0, (rect.bottom() - m_bounds.top()) / m_cellHeight, m_rows - 1);
+}
+
+void HOCRSpatialIndex::insertItem(const HOCRItem* item) {
+	QRect rect = item->bbox().normalized();
+	m_itemRects.insert(item, rect);
+	int col0, row0, col1, row1;
+	cellRange(rect, col0, row0, col1, row1);
+	for (int row = row0; row <= row1; ++row) {
+		for (int col = col0; col <= col1; ++col) {
+			m_cells[row * m_cols + col].append(item);
+		}
+	}
+}
+
+void HOCRSpatialIndex::removeItem(const HOCRItem* item) {
+	auto it = m_itemRects.find(item);
+	if (it == m_itemRects.end()) {
+		return;
+	}
+	int col0, row0, col1, row1;
+	cellRange(it.value(), col0, row0, col1, row1);
+	for (int row = row0; row <= row1; ++row) {
+		for (int col = col0; col <= col1; ++col) {
+			m_cells[row * m_cols + col].removeOne(item);
+		}
+	}
+	m_itemRects.erase(it);
+}
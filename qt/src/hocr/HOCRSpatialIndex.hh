@@ -0,0 +1,70 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRSpatialIndex.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOCRSPATIALINDEX_HH
+#define HOCRSPATIALINDEX_HH
+
+#include <QHash>
+#include <QRect>
+#include <QVector>
+
+class HOCRItem;
+class HOCRPage;
+
+/**
+ * Uniform grid over the bounding boxes of the items of a page, so that the
+ * items at a position do not need to be searched among all items of the page.
+ */
+class HOCRSpatialIndex {
+public:
+	bool isBuilt() const {
+		return m_built;
+	}
+	void build(const HOCRPage* page);
+	void clear();
+
+	// Add or remove the item and all its descendants, no-ops if the index is not built
+	void insert(const HOCRItem* item);
+	void remove(const HOCRItem* item);
+	// Re-indexes the item after its bounding box changed
+	void update(const HOCRItem* item);
+
+	// Returns the items whose bounding box intersects the rectangle
+	QVector<const HOCRItem*> query(const QRect& rect) const;
+
+private:
+	// Maximum number of cells per dimension
+	static constexpr int s_gridSize = 64;
+
+	bool m_built = false;
+	QRect m_bounds;
+	int m_cellWidth = 1;
+	int m_cellHeight = 1;
+	int m_cols = 0;
+	int m_rows = 0;
+	QVector<QVector<const HOCRItem*>> m_cells;
+	// Rectangle with which each item was indexed, needed for removing it once its bbox changed
+	QHash<const HOCRItem*, QRect> m_itemRects;
+
+	void cellRange(const QRect& rect, int& col0, int& row0, int& col1, int& row1) const;
+	void insertItem(const HOCRItem* item);
+	void removeItem(const HOCRItem* item);
+};
+
+#endif // HOCRSPATIALINDEX_HH
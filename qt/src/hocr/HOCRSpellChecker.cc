@@ -17,7 +17,10 @@
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <QCoreApplication>
 #include <QRegularExpression>
 #include <QVector>
 
@@ -25,8 +28,17 @@
 
 
 bool HOCRSpellChecker::checkSpelling(const QString& word, QStringList* suggestions, int limit) const {
+	if (suggestions) {
+		auto it = m_suggestionCache.constFind(word);
+		// Cached suggestions can be reused if no more are requested than were generated, or if there are no more
+		if (it != m_suggestionCache.constEnd() && (it->limit == -1 || (limit != -1 && limit <= it->limit) || it->suggestions.size() < it->limit)) {
+			*suggestions = limit == -1 ? it->suggestions : it->suggestions.mid(0, limit);
+			return it->valid;
+		}
+	}
+
 	QList<QPair<QString, int >> words;
-	QRegularExpression dashRe("[\\x2013\\x2014]+");
+	static const QRegularExpression dashRe("[\\x2013\\x2014]+");
 	QRegularExpressionMatch match;
 	int pos = 0;
 	while ((match = dashRe.match(word, pos)).hasMatch()) {
@@ -35,9 +47,6 @@ bool HOCRSpellChecker::checkSpelling(const QString& word, QStringList* suggestio
 	}
 	words.append(qMakePair(word.mid(pos), pos));
 
-	int perWordLimit = 0;
-	// s = p^w => w = log_p(c) = log(c)/log(p) => p = 10^(log(c)/w)
-	if (limit > 0) { perWordLimit = int (std::pow(10, std::log10(limit) / words.size())); }
 	QList<QList<QString >> wordSuggestions;
 	bool valid = true;
 	bool multipleWords = words.size() > 1;
@@ -45,48 +54,110 @@ bool HOCRSpellChecker::checkSpelling(const QString& word, QStringList* suggestio
 		QString wordString = pair.first;
 		bool wordValid = checkWord(wordString);
 		valid &= wordValid;
-		if (suggestions) {
+		if (suggestions && limit != 0) {
 			QList<QString> ws = getSpellingSuggestions(wordString);
 			if (wordValid && multipleWords) { ws.prepend(wordString); }
-			if (limit == -1) {
-				wordSuggestions.append(ws);
-			} else if (limit > 0) {
-				wordSuggestions.append(ws.mid(0, perWordLimit));
-			}
+			wordSuggestions.append(ws);
 		}
 	}
-	if (suggestions) {
-		suggestions->clear();
-		QList<QList<QString >> suggestionCombinations;
-		generateCombinations(wordSuggestions, suggestionCombinations, 0, QList<QString>());
-		for (const QList<QString>& combination : suggestionCombinations) {
+	if (!suggestions) {
+		return valid;
+	}
+	suggestions->clear();
+	if (limit != 0) {
+		// Enumerate the combinations of the suggestions for each word best first, ranked by the sum of the
+		// positions of the suggestions in their lists, until enough are found. Each combination is reached
+		// from exactly one parent by only advancing words at or after the one last advanced.
+		struct Candidate {
+			int rank;
+			QVector<int> indices;
+			int pos;
+			bool operator>(const Candidate& other) const {
+				return rank != other.rank ? rank > other.rank : other.indices < indices;
+			}
+		};
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+		bool empty = std::any_of(wordSuggestions.begin(), wordSuggestions.end(), [](const QList<QString>& ws) { return ws.isEmpty(); });
+		if (!empty) {
+			queue.push({0, QVector<int> (wordSuggestions.size(), 0), 0});
+		}
+		while (!queue.empty() && (limit == -1 || suggestions->size() < limit)) {
+			Candidate candidate = queue.top();
+			queue.pop();
+
 			QString s = "";
-			auto originalWord = words.begin();
 			int last = 0;
-			int next;
-			for (const QString& suggestedWord : combination) {
-				next = originalWord->second;
-				s.append(word.mid(last, next - last));
-				s.append(suggestedWord);
-				last = next + originalWord->first.length();
-				originalWord++;
+			for (int i = 0, n = words.size(); i < n; ++i) {
+				s.append(word.mid(last, words[i].second - last));
+				s.append(wordSuggestions[i][candidate.indices[i]]);
+				last = words[i].second + words[i].first.length();
 			}
 			s.append(word.mid(last));
-			suggestions->append(s);
+			// Don't list the exact input word
+			if (s != word) {
+				suggestions->append(s);
+			}
+
+			for (int i = candidate.pos, n = candidate.indices.size(); i < n; ++i) {
+				if (candidate.indices[i] + 1 < wordSuggestions[i].size()) {
+					Candidate next = {candidate.rank + 1, candidate.indices, i};
+					++next.indices[i];
+					queue.push(next);
+				}
+			}
 		}
-		// Don't list the exact input word
-		suggestions->removeOne(word);
 	}
+	m_suggestionCache.insert(word, {valid, *suggestions, limit});
 	return valid;
 }
 
-// each suggestion for each word => each word in each suggestion
-void HOCRSpellChecker::generateCombinations(const QList<QList<QString >> & lists, QList<QList<QString >>& results, int depth, const QList<QString>& c) const {
-	if (depth == lists.size()) {
-		results.append(c);
-		return;
+HOCRSpellCheckerPool::~HOCRSpellCheckerPool() {
+	for (Entry* entry : m_entries) {
+		delete entry->checker;
+		delete entry;
 	}
-	for (int i = 0; i < lists[depth].size(); ++i) {
-		generateCombinations(lists, results, depth + 1, c + QList<QString> ({lists[depth][i]}));
+}
+
+HOCRSpellCheckerPool::Entry* HOCRSpellCheckerPool::entry(const QString& lang) {
+	QMutexLocker locker(&m_mutex);
+	Entry*& entry = m_entries[lang];
+	if (!entry) {
+		entry = new Entry;
+		HOCRSpellChecker* checker = new HOCRSpellChecker();
+		if (checker->setLanguage(lang)) {
+			// Checkers may be created by worker threads, but are owned by the pool
+			checker->moveToThread(QCoreApplication::instance()->thread());
+			entry->checker = checker;
+		} else {
+			delete checker;
+		}
+	}
+	return entry;
+}
+
+bool HOCRSpellCheckerPool::checkSpelling(const QString& lang, const QString& word, QStringList* suggestions, int limit) {
+	Entry* e = entry(lang);
+	if (!e->checker) {
+		return true;
+	}
+	QMutexLocker locker(&e->mutex);
+	return e->checker->checkSpelling(word, suggestions, limit);
+}
+
+void HOCRSpellCheckerPool::addWordToDictionary(const QString& lang, const QString& word) {
+	Entry* e = entry(lang);
+	if (e->checker) {
+		QMutexLocker locker(&e->mutex);
+		e->checker->addWordToDictionary(word);
+		e->checker->clearSuggestionCache();
+	}
+}
+
+void HOCRSpellCheckerPool::ignoreWord(const QString& lang, const QString& word) {
+	Entry* e = entry(lang);
+	if (e->checker) {
+		QMutexLocker locker(&e->mutex);
+		e->checker->ignoreWord(word);
+		e->checker->clearSuggestionCache();
 	}
 }
@@ -20,6 +20,8 @@
 #ifndef HOCRSPELLCHECKER_HH
 #define HOCRSPELLCHECKER_HH
 
+#include <QHash>
+#include <QMutex>
 #include <QtSpell.hpp>
 
 class HOCRSpellChecker : public QtSpell::Checker {
@@ -35,8 +37,43 @@ public:
 	void insertWord(int /*start*/, int /*end*/, const QString& /*word*/) override { }
 	bool isAttached() const override { return true; }
 
+	// Must be called when the dictionary changes
+	void clearSuggestionCache() {
+		m_suggestionCache.clear();
+	}
+
 private:
-	void generateCombinations(const QList<QList<QString >> & lists, QList<QList<QString >>& results, int depth, const QList<QString>& c) const;
+	struct CachedSuggestions {
+		bool valid;
+		QStringList suggestions;
+		int limit;
+	};
+	mutable QHash<QString, CachedSuggestions> m_suggestionCache;
+};
+
+/**
+ * One spell checker per language, so that words of different languages can be
+ * checked without reloading dictionaries. Lookups are thread safe, lookups in
+ * different languages run concurrently.
+ */
+class HOCRSpellCheckerPool {
+public:
+	~HOCRSpellCheckerPool();
+
+	// Words of languages without an installed dictionary are considered correct
+	bool checkSpelling(const QString& lang, const QString& word, QStringList* suggestions = nullptr, int limit = -1);
+	void addWordToDictionary(const QString& lang, const QString& word);
+	void ignoreWord(const QString& lang, const QString& word);
+
+private:
+	struct Entry {
+		HOCRSpellChecker* checker = nullptr;
+		QMutex mutex;
+	};
+	QMutex m_mutex;
+	QHash<QString, Entry*> m_entries;
+
+	Entry* entry(const QString& lang);
 };
 
 #endif // HOCRSPELLCHECKER_HH
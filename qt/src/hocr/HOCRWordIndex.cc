@@ -0,0 +1,107 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRWordIndex.cc
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HOCRDocument.hh"
+#include "HOCRWordIndex.hh"
+#include "Utils.hh"
+
+
+QString HOCRWordIndex::normalize(const QString& text) {
+	// Case folding, like the case insensitive comparisons the index pre-filters for
+	return Utils::removeDiacritics(text.toCaseFolded());
+}
+
+void HOCRWordIndex::addPage(const HOCRPage* page) {
+	for (auto it = page->m_wordCounts.begin(), itEnd = page->m_wordCounts.end(); it != itEnd; ++it) {
+		m_postings[it.key()].insert(page, it.value());
+	}
+}
+
+void HOCRWordIndex::removePage(const HOCRPage* page) {
+	for (auto it = page->m_wordCounts.begin(), itEnd = page->m_wordCounts.end(); it != itEnd; ++it) {
+		auto postingIt = m_postings.find(it.key());
+		if (postingIt != m_postings.end()) {
+			postingIt.value().remove(page);
+			if (postingIt.value().isEmpty()) {
+				m_postings.erase(postingIt);
+			}
+		}
+	}
+}
+
+void HOCRWordIndex::addWord(HOCRPage* page, const QString& text) {
+	QString word = normalize(text);
+	if (!word.isEmpty()) {
+		++page->m_wordCounts[word];
+		++m_postings[word][page];
+	}
+}
+
+void HOCRWordIndex::removeWord(HOCRPage* page, const QString& text) {
+	QString word = normalize(text);
+	auto countIt = page->m_wordCounts.find(word);
+	if (countIt == page->m_wordCounts.end()) {
+		return;
+	}
+	if (--countIt.value() == 0) {
+		page->m_wordCounts.erase(countIt);
+	}
+	auto postingIt = m_postings.find(word);
+	if (postingIt != m_postings.end()) {
+		auto pageIt = postingIt.value().find(page);
+		if (pageIt != postingIt.value().end() && --pageIt.value() == 0) {
+			postingIt.value().erase(pageIt);
+			if (postingIt.value().isEmpty()) {
+				m_postings.erase(postingIt);
+			}
+		}
+	}
+}
+
+QSet<const HOCRPage*> HOCRWordIndex::pagesContaining(const QString& text) const {
+	// The vocabulary is much smaller than the number of words of the document
+	QString normalized = normalize(text);
+	QSet<const HOCRPage*> pages;
+	for (auto it = m_postings.begin(), itEnd = m_postings.end(); it != itEnd; ++it) {
+		if (it.key().contains(normalized)) {
+			for (auto pageIt = it.value().begin(), pageItEnd = it.value().end(); pageIt != pageItEnd; ++pageIt) {
+				pages.insert(pageIt.key());
+			}
+		}
+	}
+	return pages;
+}
+
+QSet<const HOCRPage*> HOCRWordIndex::pagesContainingAny(const QStringList& texts) const {
+	QStringList normalized;
+	for (const QString& text : texts) {
+		normalized.append(normalize(text));
+	}
+	// Scan the vocabulary once for all texts
+	Utils::MultiPatternMatcher matcher(normalized);
+	QSet<const HOCRPage*> pages;
+	for (auto it = m_postings.begin(), itEnd = m_postings.end(); it != itEnd; ++it) {
+		if (matcher.containsAny(it.key())) {
+			for (auto pageIt = it.value().begin(), pageItEnd = it.value().end(); pageIt != pageItEnd; ++pageIt) {
+				pages.insert(pageIt.key());
+			}
+		}
+	}
+	return pages;
+}
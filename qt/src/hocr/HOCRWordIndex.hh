@@ -0,0 +1,57 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * HOCRWordIndex.hh
+ * Copyright (C) 2025 Sandro Mani <manisandro@gmail.com>
+ *
+ * gImageReader is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gImageReader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOCRWORDINDEX_HH
+#define HOCRWORDINDEX_HH
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class HOCRPage;
+
+/**
+ * Inverted index from the words of a document to the pages containing them.
+ * Words are indexed case and diacritic insensitive. The index does not refer
+ * to individual items, so that it remains valid while pages are evicted.
+ */
+class HOCRWordIndex {
+public:
+	static QString normalize(const QString& text);
+
+	void clear() {
+		m_postings.clear();
+	}
+	void addPage(const HOCRPage* page);
+	void removePage(const HOCRPage* page);
+	void addWord(HOCRPage* page, const QString& text);
+	void removeWord(HOCRPage* page, const QString& text);
+
+	// Pages with a word containing the text, ignoring case and diacritics
+	QSet<const HOCRPage*> pagesContaining(const QString& text) const;
+	// Pages with a word containing any of the texts, ignoring case and diacritics
+	QSet<const HOCRPage*> pagesContainingAny(const QStringList& texts) const;
+
+private:
+	// normalized word : page : occurrences
+	QHash<QString, QHash<const HOCRPage*, int>> m_postings;
+};
+
+#endif // HOCRWORDINDEX_HH
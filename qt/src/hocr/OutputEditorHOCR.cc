@@ -28,12 +28,14 @@
 #include <QStyledItemDelegate>
 #include <QMessageBox>
 #include <QPointer>
+#include <QSaveFile>
 #include <QStandardItemModel>
 #include <QSyntaxHighlighter>
 #include <QtSpell.hpp>
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <limits>
 #define USE_STD_NAMESPACE
 #include <tesseract/baseapi.h>
 #include <tesseract/ocrclass.h>
@@ -42,10 +44,14 @@
 #include "ConfigSettings.hh"
 #include "DisplayerToolHOCR.hh"
 #include "FileDialogs.hh"
+#include "GzipDevice.hh"
 #include "HOCRDocument.hh"
+#include "HOCRJournal.hh"
 #include "HOCROdtExporter.hh"
 #include "HOCRPdfExporter.hh"
+#include "HOCRProject.hh"
 #include "HOCRProofReadWidget.hh"
+#include "HOCRReader.hh"
 #include "HOCRTextExporter.hh"
 #include "MainWindow.hh"
 #include "OutputEditorHOCR.hh"
@@ -240,6 +246,31 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+class OpenProgressMonitor : public MainWindow::ProgressMonitor {
+public:
+	OpenProgressMonitor(qint64 totalBytes) : MainWindow::ProgressMonitor(1), mTotalBytes(std::max(qint64(1), totalBytes)) {}
+	void setBytesRead(qint64 bytes) {
+		QMutexLocker locker(&mMutex);
+		mBytesRead = mBytesDone + bytes;
+	}
+	void finishFile(qint64 size) {
+		QMutexLocker locker(&mMutex);
+		mBytesDone += size;
+		mBytesRead = mBytesDone;
+	}
+	int getProgress() const override {
+		QMutexLocker locker(&mMutex);
+		return (mBytesRead * 100) / mTotalBytes;
+	}
+
+private:
+	qint64 mTotalBytes;
+	qint64 mBytesDone = 0;
+	qint64 mBytesRead = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 void OutputEditorHOCR::HOCRBatchProcessor::writeHeader(QIODevice* dev, tesseract::TessBaseAPI* tess, const PageInfo& pageInfo) const {
 	QString header = QString(
 	                     "<!DOCTYPE html>\n"
@@ -303,6 +334,9 @@ OutputEditorHOCR::OutputEditorHOCR(DisplayerToolHOCR* tool) {
 
 	m_document = new HOCRDocument(ui.treeViewHOCR);
 	ui.treeViewHOCR->setModel(m_document);
+	m_journal = new HOCRJournal(m_document);
+	// Offered once the editor is set up
+	QTimer::singleShot(0, this, &OutputEditorHOCR::recoverJournals);
 	ui.treeViewHOCR->setContextMenuPolicy(Qt::CustomContextMenu);
 	ui.treeViewHOCR->header()->setStretchLastSection(false);
 	ui.treeViewHOCR->header()->setSectionResizeMode(0, QHeaderView::Stretch);
@@ -373,6 +407,7 @@ OutputEditorHOCR::OutputEditorHOCR(DisplayerToolHOCR* tool) {
 
 OutputEditorHOCR::~OutputEditorHOCR() {
 	m_previewTimer.stop();
+	delete m_journal;
 	delete m_preview;
 	delete m_proofReadWidget;
 	delete m_widget;
@@ -915,12 +950,19 @@ void OutputEditorHOCR::toggleWConfColumn(bool active) {
 	ui.treeViewHOCR->setColumnHidden(1, !active);
 }
 
+void OutputEditorHOCR::recoverJournals() {
+	QStringList files = HOCRJournal::recoverAbandonedJournals(m_document->defaultLanguage());
+	if (!files.isEmpty() && QMessageBox::question(MAIN, _("Recovered hOCR output"), _("The hOCR output of a session which did not terminate properly was recovered to:\n%1\n\nOpen it now?").arg(files.join("\n"))) == QMessageBox::Yes) {
+		open(InsertMode::Append, files);
+	}
+}
+
 bool OutputEditorHOCR::open(InsertMode mode, QStringList files) {
 	if (mode == InsertMode::Replace && !clear(false)) {
 		return false;
 	}
 	if (files.isEmpty()) {
-		files = FileDialogs::openDialog(_("Open hOCR File"), "", "outputdir", QString("%1 (*.html)").arg(_("hOCR HTML Files")), true);
+		files = FileDialogs::openDialog(_("Open hOCR File"), "", "outputdir", QString("%1 (*.html *.html.gz *.hocr.gz *.ghocr);;%2 (*.html *.html.gz *.hocr.gz);;%3 (*.ghocr)").arg(_("hOCR Files")).arg(_("hOCR HTML Files")).arg(_("hOCR Projects")), true);
 	}
 	if (files.isEmpty()) {
 		return false;
@@ -929,32 +971,102 @@ bool OutputEditorHOCR::open(InsertMode mode, QStringList files) {
 	QStringList failed;
 	QStringList invalid;
 	int added = 0;
+	qint64 totalSize = 0;
 	for (const QString& filename : files) {
-		QFile file(filename);
-		if (!file.open(QIODevice::ReadOnly)) {
-			failed.append(filename);
-			continue;
-		}
-		QDomDocument doc;
-		doc.setContent(&file);
-		QDomElement div = doc.firstChildElement("html").firstChildElement("body").firstChildElement("div");
-		if (div.isNull() || div.attribute("class") != "ocr_page") {
-			invalid.append(filename);
-			continue;
-		}
-		while (!div.isNull()) {
-			// Need to query next before adding page since the element is reparented
-			QDomElement nextDiv = div.nextSiblingElement("div");
-			m_document->insertPage(pos++, div, false, QFileInfo(filename).absolutePath());
-			div = nextDiv;
-			++added;
+		totalSize += QFileInfo(filename).size();
+	}
+	OpenProgressMonitor monitor(totalSize);
+	MAIN->showProgress(&monitor);
+	{
+		// Events are processed while the pages are inserted, only the cancel button must be usable meanwhile
+		Utils::BusyScope busy(_("Opening hOCR files..."));
+		m_journal->beginLoad();
+		for (const QString& filename : files) {
+			QFile file(filename);
+			if (!file.open(QIODevice::ReadOnly)) {
+				failed.append(filename);
+				continue;
+			}
+			if (filename.endsWith(".ghocr", Qt::CaseInsensitive)) {
+				// Projects are mapped rather than read, their pages are read once they are accessed
+				QSharedPointer<HOCRProject> project = HOCRProject::open(filename);
+				if (!project) {
+					invalid.append(filename);
+				} else {
+					m_document->beginInsertPages();
+					for (int i = 0, n = project->pageCount(); i < n; ++i) {
+						m_document->insertPage(pos++, project, i, QFileInfo(filename).absolutePath());
+					}
+					m_document->endInsertPages();
+					m_journal->addSourcePages(filename, pos - project->pageCount(), project->pageCount());
+					added += project->pageCount();
+				}
+				monitor.finishFile(file.size());
+				continue;
+			}
+			// Pages are inserted as soon as they are read, so that the first pages show up immediately.
+			// Their items are only parsed once they are needed.
+			int fileStart = pos;
+			bool error = false;
+			// Compressed files are decompressed while they are read, hence can't be split beforehand
+			bool compressed = GzipDevice::isGzipFile(filename);
+			const uchar* mapped = !compressed && file.size() < std::numeric_limits<int>::max() ? file.map(0, file.size()) : nullptr;
+			QByteArray data = mapped ? QByteArray::fromRawData(reinterpret_cast<const char*> (mapped), file.size()) : QByteArray();
+			QVector<QPair<int, int>> pageRanges;
+			if (mapped && HOCRReader::splitPages(data, pageRanges)) {
+				// The pages are parsed concurrently
+				int inserted = 0;
+				error = pageRanges.isEmpty() || !m_document->insertPages(pos, data, pageRanges, QFileInfo(filename).absolutePath(), [&](int pagesRead) {
+					monitor.setBytesRead(pageRanges[pagesRead - 1].second);
+					QApplication::processEvents();
+					return !monitor.cancelled();
+				}, inserted);
+				pos += inserted;
+			} else {
+				GzipDevice gzipDevice(&file);
+				if (compressed && !gzipDevice.open(QIODevice::ReadOnly)) {
+					invalid.append(filename);
+					monitor.finishFile(file.size());
+					continue;
+				}
+				HOCRReader reader(compressed ? static_cast<QIODevice*> (&gzipDevice) : &file);
+				QDomElement div;
+				QByteArray pageXml;
+				int childCount = 0;
+				HOCRPageWords words;
+				m_document->beginInsertPages();
+				while (!monitor.cancelled() && !(div = reader.readNextPage(pageXml, childCount, words)).isNull()) {
+					m_document->insertPage(pos++, div, pageXml, childCount, words, QFileInfo(filename).absolutePath());
+					monitor.setBytesRead(file.pos());
+					QApplication::processEvents();
+				}
+				m_document->endInsertPages();
+				error = reader.hasError();
+			}
+			if (!monitor.cancelled() && error) {
+				// Don't keep a partially read file
+				while (pos > fileStart) {
+					m_document->removeItem(m_document->index(--pos, 0));
+				}
+				invalid.append(filename);
+			} else {
+				// Unmodified pages are recovered from the file after a crash
+				m_journal->addSourcePages(filename, fileStart, pos - fileStart);
+				added += pos - fileStart;
+			}
+			monitor.finishFile(file.size());
+			if (monitor.cancelled()) {
+				break;
+			}
 		}
+		m_journal->endLoad();
 	}
+	MAIN->hideProgress();
 	if (added > 0) {
 		m_modified = mode != InsertMode::Replace;
 		if (mode == InsertMode::Replace && m_filebasename.isEmpty()) {
 			QFileInfo finfo(files.front());
-			m_filebasename = finfo.absoluteDir().absoluteFilePath(finfo.completeBaseName());
+			m_filebasename = finfo.absoluteDir().absoluteFilePath(stripHOCRSuffix(finfo.fileName()));
 		}
 		MAIN->setOutputPaneVisible(true);
 	}
@@ -982,6 +1094,15 @@ bool OutputEditorHOCR::selectPage(int nr) {
 	return index.isValid();
 }
 
+QString OutputEditorHOCR::stripHOCRSuffix(const QString& filename) {
+	for (const char* suffix : {".html.gz", ".hocr.gz", ".html", ".ghocr"}) {
+		if (filename.endsWith(suffix, Qt::CaseInsensitive)) {
+			return filename.left(filename.length() - int(std::strlen(suffix)));
+		}
+	}
+	return QFileInfo(filename).completeBaseName();
+}
+
 bool OutputEditorHOCR::save(const QString& filename) {
 	ui.treeViewHOCR->setFocus(); // Ensure any item editor loses focus and commits its changes
 	QString outname = filename;
@@ -996,37 +1117,66 @@ bool OutputEditorHOCR::save(const QString& filename) {
 				suggestion = _("output");
 			}
 		}
-		outname = FileDialogs::saveDialog(_("Save hOCR Output..."), suggestion + ".html", "outputdir", QString("%1 (*.html)").arg(_("hOCR HTML Files")));
+		outname = FileDialogs::saveDialog(_("Save hOCR Output..."), suggestion + ".html", "outputdir", QString("%1 (*.html);;%2 (*.html.gz);;%3 (*.ghocr)").arg(_("hOCR HTML Files")).arg(_("Compressed hOCR HTML Files")).arg(_("hOCR Projects")));
 		if (outname.isEmpty()) {
 			return false;
 		}
 	}
-	QFile file(outname);
+	// The previous file is only replaced once the complete document has been written
+	QSaveFile file(outname);
 	if (!file.open(QIODevice::WriteOnly)) {
 		QMessageBox::critical(MAIN, _("Failed to save output"), _("Check that you have writing permissions in the selected folder."));
 		return false;
 	}
-	QByteArray current = setlocale(LC_ALL, NULL);
-	setlocale(LC_ALL, "C");
-	tesseract::TessBaseAPI tess;
-	setlocale(LC_ALL, current.constData());
-	QString header = QString(
-	                     "<!DOCTYPE html>\n"
-	                     "<html>\n"
-	                     "<head>\n"
-	                     " <title>%1</title>\n"
-	                     " <meta charset=\"utf-8\" /> \n"
-	                     " <meta name='ocr-system' content='tesseract %2' />\n"
-	                     " <meta name='ocr-capabilities' content='ocr_page ocr_carea ocr_par ocr_line ocrx_word'/>\n"
-	                     "</head>\n").arg(QFileInfo(outname).fileName()).arg(tess.Version());
-	file.write(header.toUtf8());
+	bool success = false;
+	bool project = outname.endsWith(".ghocr", Qt::CaseInsensitive);
 	m_document->convertSourcePaths(QFileInfo(outname).absolutePath(), false);
-	file.write(m_document->toHTML().toUtf8());
+	if (project) {
+		success = m_document->writeProject(&file);
+		// A mapped file can't be replaced on all platforms
+		if (success) {
+			m_document->releaseProject(outname);
+		}
+	} else {
+		QByteArray current = setlocale(LC_ALL, NULL);
+		setlocale(LC_ALL, "C");
+		tesseract::TessBaseAPI tess;
+		setlocale(LC_ALL, current.constData());
+		QString header = QString(
+		                     "<!DOCTYPE html>\n"
+		                     "<html>\n"
+		                     "<head>\n"
+		                     " <title>%1</title>\n"
+		                     " <meta charset=\"utf-8\" /> \n"
+		                     " <meta name='ocr-system' content='tesseract %2' />\n"
+		                     " <meta name='ocr-capabilities' content='ocr_page ocr_carea ocr_par ocr_line ocrx_word'/>\n"
+		                     "</head>\n").arg(QFileInfo(outname).fileName()).arg(tess.Version());
+		// Compressed output is written through a gzip stream
+		GzipDevice gzipDevice(&file);
+		QIODevice* output = &file;
+		if (GzipDevice::isGzipFile(outname)) {
+			gzipDevice.open(QIODevice::WriteOnly);
+			output = &gzipDevice;
+		}
+		success = output->isOpen() && output->write(header.toUtf8()) >= 0 && m_document->writeHTML(output) && output->write("</html>\n") >= 0;
+		gzipDevice.close();
+		success = success && !gzipDevice.hasError();
+	}
 	m_document->convertSourcePaths(QFileInfo(outname).absolutePath(), true);
-	file.write("</html>\n");
+	if (!success || !file.commit()) {
+		QMessageBox::critical(MAIN, _("Failed to save output"), _("The output could not be written: %1").arg(file.errorString()));
+		return false;
+	}
+	if (project) {
+		// The pages can be dropped from memory again once they are read from the saved project
+		QSharedPointer<HOCRProject> savedProject = HOCRProject::open(outname);
+		if (savedProject) {
+			m_document->attachProject(savedProject);
+		}
+	}
 	m_modified = false;
 	QFileInfo finfo(outname);
-	m_filebasename = finfo.absoluteDir().absoluteFilePath(finfo.completeBaseName());
+	m_filebasename = finfo.absoluteDir().absoluteFilePath(stripHOCRSuffix(finfo.fileName()));
 	return true;
 }
 
@@ -1042,8 +1192,13 @@ QString OutputEditorHOCR::crashSave(const QString& filename) const {
 		                     " <meta name='ocr-capabilities' content='ocr_page ocr_carea ocr_par ocr_line ocrx_word'/>\n"
 		                     "</head>\n").arg(QFileInfo(filename).fileName());
 		file.write(header.toUtf8());
+		// Replaying the journal only needs to serialize the pages edited since the last autosave
 		m_document->convertSourcePaths(QFileInfo(filename).absolutePath(), false);
-		file.write(m_document->toHTML().toUtf8());
+		if (!m_journal->replay(&file)) {
+			file.seek(header.toUtf8().size());
+			file.resize(file.pos());
+			m_document->writeHTML(&file);
+		}
 		m_document->convertSourcePaths(QFileInfo(filename).absolutePath(), true);
 		file.write("</html>\n");
 		return filename + ".html";
@@ -1223,10 +1378,31 @@ void OutputEditorHOCR::findReplace(const QString& searchstr, const QString& repl
 	if (!current.isValid()) {
 		current = m_document->index(backwards ? (m_document->rowCount() - 1) : 0, 0);
 	}
+	// Pages which don't contain the search text are skipped as a whole
+	QSet<const HOCRPage*> pages = m_document->pagesContainingText(searchstr);
+	const HOCRItem* currentItem = m_document->itemAtIndex(current);
+	const HOCRPage* currentPage = currentItem ? currentItem->page() : nullptr;
+	int nPages = m_document->pageCount();
 	QModelIndex neww = current;
 	bool currentSelectionMatchesSearch = false;
 	while (!findReplaceInItem(neww, searchstr, replacestr, matchCase, backwards, replace, currentSelectionMatchesSearch)) {
 		neww = backwards ? m_document->prevIndex(neww) : m_document->nextIndex(neww);
+		const HOCRItem* item = m_document->itemAtIndex(neww);
+		if (item && !pages.contains(item->page())) {
+			int row = item->page()->index();
+			do {
+				row = (row + (backwards ? nPages - 1 : 1)) % nPages;
+			} while (m_document->page(row) != currentPage && !pages.contains(m_document->page(row)));
+			if (!pages.contains(m_document->page(row))) {
+				// Back at the page where the search started
+				neww = QModelIndex();
+			} else if (backwards) {
+				// Continue at the last item of the page
+				neww = m_document->prevIndex(m_document->index((row + 1) % nPages, 0));
+			} else {
+				neww = m_document->index(row, 0);
+			}
+		}
 		if (!neww.isValid() || neww == current) {
 			// Break endless loop
 			if (!currentSelectionMatchesSearch) {
@@ -1239,21 +1415,23 @@ void OutputEditorHOCR::findReplace(const QString& searchstr, const QString& repl
 
 void OutputEditorHOCR::replaceAll(const QString& searchstr, const QString& replacestr, bool matchCase) {
 	MAIN->pushState(MainWindow::State::Busy, _("Replacing..."));
-	QModelIndex start = m_document->index(0, 0);
-	QModelIndex curr = start;
 	Qt::CaseSensitivity cs = matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
 	int count = 0;
-	do {
-		const HOCRItem* item = m_document->itemAtIndex(curr);
-		if (item && item->itemClass() == "ocrx_word") {
-			if (item->text().contains(searchstr, cs)) {
-				++count;
-				m_document->setData(curr, item->text().replace(searchstr, replacestr, cs), Qt::EditRole);
-			}
+	// Only the pages which may contain the search text need to be visited
+	QSet<const HOCRPage*> pages = m_document->pagesContainingText(searchstr);
+	for (int iPage = 0, nPages = m_document->pageCount(); iPage < nPages; ++iPage) {
+		if (!pages.contains(m_document->page(iPage))) {
+			continue;
 		}
-		curr = m_document->nextIndex(curr);
+		count += m_document->replaceWordTexts(m_document->index(iPage, 0), [&](QString & text) {
+			if (!text.contains(searchstr, cs)) {
+				return false;
+			}
+			text.replace(searchstr, replacestr, cs);
+			return true;
+		});
 		QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-	} while (curr != start);
+	}
 	if (count == 0) {
 		ui.searchFrame->setErrorState();
 	}
@@ -1262,20 +1440,26 @@ void OutputEditorHOCR::replaceAll(const QString& searchstr, const QString& repla
 
 void OutputEditorHOCR::applySubstitutions(const QMap<QString, QString>& substitutions, bool matchCase) {
 	MAIN->pushState(MainWindow::State::Busy, _("Applying substitutions..."));
-	QModelIndex start = m_document->index(0, 0);
 	Qt::CaseSensitivity cs = matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
-	for (auto it = substitutions.begin(), itEnd = substitutions.end(); it != itEnd; ++it) {
-		QString search = it.key();
-		QString replace = it.value();
-		QModelIndex curr = start;
-		do {
-			const HOCRItem* item = m_document->itemAtIndex(curr);
-			if (item && item->itemClass() == "ocrx_word") {
-				m_document->setData(curr, item->text().replace(search, replace, cs), Qt::EditRole);
+	// Words are scanned once for all search strings. Only words containing any of them are
+	// rewritten, applying the substitutions in order, which gives the same result as applying
+	// each substitution to all words in turn.
+	Utils::MultiPatternMatcher matcher(substitutions.keys(), cs);
+	QSet<const HOCRPage*> pages = m_document->pagesContainingAnyText(substitutions.keys());
+	for (int iPage = 0, nPages = m_document->pageCount(); iPage < nPages; ++iPage) {
+		if (!pages.contains(m_document->page(iPage))) {
+			continue;
+		}
+		m_document->replaceWordTexts(m_document->index(iPage, 0), [&](QString & text) {
+			if (!matcher.containsAny(text)) {
+				return false;
+			}
+			for (auto it = substitutions.begin(), itEnd = substitutions.end(); it != itEnd; ++it) {
+				text.replace(it.key(), it.value(), cs);
 			}
-			curr = m_document->nextIndex(curr);
-			QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-		} while (curr != start);
+			return true;
+		});
+		QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
 	}
 	MAIN->popState();
 }
@@ -28,6 +28,7 @@
 class DisplayerToolHOCR;
 class HOCRDocument;
 class HOCRItem;
+class HOCRJournal;
 class HOCRPage;
 class HOCRProofReadWidget;
 class QGraphicsPixmapItem;
@@ -37,10 +38,13 @@ class OutputEditorHOCR : public OutputEditor {
 public:
 	class HOCRBatchProcessor : public BatchProcessor {
 	public:
-		QString fileSuffix() const override { return QString(".html"); }
+		HOCRBatchProcessor(bool compress) : m_compress(compress) {}
+		QString fileSuffix() const override { return QString(m_compress ? ".html.gz" : ".html"); }
 		void writeHeader(QIODevice* dev, tesseract::TessBaseAPI* tess, const PageInfo& pageInfo) const override;
 		void writeFooter(QIODevice* dev) const override;
 		void appendOutput(QIODevice* dev, tesseract::TessBaseAPI* tess, const PageInfo& pageInfos, bool firstArea) const override;
+	private:
+		bool m_compress = false;
 	};
 
 	enum class InsertMode { Replace, Append, InsertBefore };
@@ -55,7 +59,7 @@ public:
 	void read(tesseract::TessBaseAPI& tess, ReadSessionData* data) override;
 	void readError(const QString& errorMsg, ReadSessionData* data) override;
 	void finalizeRead(ReadSessionData* data) override;
-	BatchProcessor* createBatchProcessor(const QMap<QString, QVariant>& /*options*/) const override { return new HOCRBatchProcessor; }
+	BatchProcessor* createBatchProcessor(const QMap<QString, QVariant>& options) const override { return new HOCRBatchProcessor(options["compress"].toBool()); }
 	bool containsSource(const QString& source, int sourcePage) const override;
 	QString crashSave(const QString& filename) const override;
 
@@ -97,6 +101,7 @@ private:
 	InsertMode m_insertMode = InsertMode::Append;
 
 	HOCRDocument* m_document;
+	HOCRJournal* m_journal;
 
 	QWidget* createAttrWidget(const QModelIndex& itemIndex, const QString& attrName, const QString& attrValue, const QString& attrItemClass = QString(), bool multiple = false);
 	void expandCollapseChildren(const QModelIndex& index, bool expand) const;
@@ -106,6 +111,8 @@ private:
 	bool showPage(const HOCRPage* page);
 	int currentPage();
 	void drawPreview(QPainter& painter, const HOCRItem* item);
+	// Strips the hOCR file suffix (.html, .html.gz, .hocr.gz, .ghocr) from the file name
+	static QString stripHOCRSuffix(const QString& filename);
 
 private slots:
 	void bboxDrawn(const QRect& bbox, int action);
@@ -124,6 +131,7 @@ private slots:
 		navigateNextPrev(false);
 	}
 	void pickItem(const QPoint& point);
+	void recoverJournals();
 	void setFont();
 	void setInsertMode(QAction* action);
 	void setModified();